@@ -32,6 +32,8 @@ extern pid_t vfork(void);
 
 extern int running;
 extern long heartbeat_freq, db_top;
+extern long method_cache_hits, method_cache_misses;
+extern long method_cache_invalidations, ancestry_rebuilds;
 
 /* All of the functions in this file are interpreter function operators, so
  * they require that the interpreter data (the globals in execute.c) be in a
@@ -449,6 +451,7 @@ void op_set_heartbeat_freq(void)
 	args[0].u.val = -1;
     heartbeat_freq = args[0].u.val;
     pop(1);
+    push_int(1);
 }
 
 void op_data(void)
@@ -550,3 +553,259 @@ void op_db_top(void)
     push_int(db_top);
 }
 
+/* Effects: Returns a list of method cache statistics: the number of lookups
+ *	    answered from cache, the number of lookups which missed, the number
+ *	    of changes which invalidated cached lookups, and the number of
+ *	    ancestors lists rebuilt. */
+void op_method_cache_stats(void)
+{
+    List *stats;
+    Data *d;
+
+    if (!func_init_0())
+	return;
+
+    stats = list_new(4);
+    d = list_empty_spaces(stats, 4);
+    d[0].type = d[1].type = d[2].type = d[3].type = INTEGER;
+    d[0].u.val = method_cache_hits;
+    d[1].u.val = method_cache_misses;
+    d[2].u.val = method_cache_invalidations;
+    d[3].u.val = ancestry_rebuilds;
+    push_list(stats);
+    list_discard(stats);
+}
+
+void op_create_many(void)
+{
+    Data *args, *d;
+    List *parents, *dbrefs;
+
+    /* Accept a list of parents and a number of objects to create. */
+    if (!func_init_2(&args, LIST, INTEGER))
+	return;
+
+    if (cur_frame->object->dbref != SYSTEM_DBREF) {
+	throw(perm_id, "Current object (#%l) is not the system object.",
+	      cur_frame->object->dbref);
+	return;
+    }
+
+    if (args[1].u.val < 0) {
+	throw(range_id, "Number of objects (%l) is less than zero.",
+	      args[1].u.val);
+	return;
+    }
+
+    /* Creating an object costs a tick, which also keeps the count well
+     * within the range of an int. */
+    if (!frame_charge(args[1].u.val)) {
+	throw(ticks_id, "Not enough ticks left to create %l objects.",
+	      args[1].u.val);
+	return;
+    }
+
+    /* Get parents list from first argument. */
+    parents = args[0].u.list;
+
+    /* Verify that all parents are dbrefs. */
+    for (d = list_first(parents); d; d = list_next(parents, d)) {
+	if (d->type != DBREF) {
+	    throw(type_id, "Parent %D is not a dbref.", d);
+	    return;
+	} else if (!cache_check(d->u.dbref)) {
+	    throw(objnf_id, "Parent %D does not refer to an object.", d);
+	    return;
+	}
+    }
+
+    /* Create the new objects. */
+    dbrefs = object_new_many(parents, args[1].u.val);
+
+    pop(2);
+    push_list(dbrefs);
+    list_discard(dbrefs);
+}
+
+void op_destroy_many(void)
+{
+    Data *args, *d;
+    List *dbrefs;
+    Object *obj;
+
+    /* Accept a list of dbrefs to destroy. */
+    if (!func_init_1(&args, LIST))
+	return;
+
+    if (cur_frame->object->dbref != SYSTEM_DBREF) {
+	throw(perm_id, "Current object (#%l) is not the system object.",
+	      cur_frame->object->dbref);
+	return;
+    }
+
+    /* Check all the dbrefs before we destroy anything. */
+    dbrefs = args[0].u.list;
+    for (d = list_first(dbrefs); d; d = list_next(dbrefs, d)) {
+	if (d->type != DBREF) {
+	    throw(type_id, "Object %D is not a dbref.", d);
+	    return;
+	} else if (d->u.dbref == ROOT_DBREF) {
+	    throw(perm_id, "You can't destroy the root object.");
+	    return;
+	} else if (d->u.dbref == SYSTEM_DBREF) {
+	    throw(perm_id, "You can't destroy the system object.");
+	    return;
+	} else if (!cache_check(d->u.dbref)) {
+	    throw(objnf_id, "Object %D not found.", d);
+	    return;
+	}
+    }
+
+    /* Destroying an object costs a tick. */
+    if (!frame_charge(list_length(dbrefs))) {
+	throw(ticks_id, "Not enough ticks left to destroy %d objects.",
+	      list_length(dbrefs));
+	return;
+    }
+
+    /* Set the objects dead, as in op_destroy(). */
+    for (d = list_first(dbrefs); d; d = list_next(dbrefs, d)) {
+	obj = cache_retrieve(d->u.dbref);
+	if (obj) {
+	    obj->dead = 1;
+	    cache_discard(obj);
+	}
+    }
+
+    pop(1);
+    push_int(1);
+}
+
+/* Effects: If called by the system object with a task ID and an optional
+ *	    value, lets the suspended task with that ID run again, with the
+ *	    value (or 0) as the result of its suspend() call, and returns 1. */
+void op_resume(void)
+{
+    Data *args;
+    int num_args;
+
+    /* Accept a task ID and an optional value. */
+    if (!func_init_1_or_2(&args, &num_args, INTEGER, 0))
+	return;
+
+    if (cur_frame->object->dbref != SYSTEM_DBREF) {
+	throw(perm_id, "Current object (#%l) is not the system object.",
+	      cur_frame->object->dbref);
+    } else if (!task_resume(args[0].u.val,
+			    (num_args == 2) ? &args[1] : NULL)) {
+	throw(tasknf_id, "No suspended task %l.", args[0].u.val);
+    } else {
+	pop(num_args);
+	push_int(1);
+    }
+}
+
+/* Effects: If called by the system object with a task ID, ends the suspended
+ *	    or waiting task with that ID, and returns 1. */
+void op_cancel(void)
+{
+    Data *args;
+
+    /* Accept a task ID. */
+    if (!func_init_1(&args, INTEGER))
+	return;
+
+    if (cur_frame->object->dbref != SYSTEM_DBREF) {
+	throw(perm_id, "Current object (#%l) is not the system object.",
+	      cur_frame->object->dbref);
+    } else if (!task_cancel(args[0].u.val)) {
+	throw(tasknf_id, "No suspended or waiting task %l.", args[0].u.val);
+    } else {
+	pop(1);
+	push_int(1);
+    }
+}
+
+void op_schedule(void)
+{
+    Data *args;
+    int num_args;
+    List *list;
+    long id;
+
+    /* Accept a delay, a dbref, a message and an optional argument list. */
+    if (!func_init_3_or_4(&args, &num_args, INTEGER, DBREF, SYMBOL, LIST))
+	return;
+
+    if (cur_frame->object->dbref != SYSTEM_DBREF) {
+	throw(perm_id, "Current object (#%l) is not the system object.",
+	      cur_frame->object->dbref);
+    } else if (args[0].u.val < 0) {
+	throw(range_id, "Delay (%l) is less than zero.", args[0].u.val);
+    } else {
+	list = (num_args == 4) ? list_dup(args[3].u.list) : list_new(0);
+	id = task_schedule(args[0].u.val, args[1].u.dbref, args[2].u.symbol,
+			   list);
+	list_discard(list);
+	pop(num_args);
+	push_int(id);
+    }
+}
+
+/* Modifies:	The database files, via make_query().
+ * Effects:	If called by the system object, sends message to dbref with the
+ *		arguments in the optional list, in a separate process working
+ *		on a snapshot of the database, and returns an ID for the
+ *		query.  The process can't change the database.  The current
+ *		object gets the value the message returns later, in a 'query
+ *		message with the ID. */
+void op_query(void)
+{
+    Data *args;
+    int num_args;
+    List *list;
+    long id;
+
+    /* Accept a dbref, a message and an optional argument list. */
+    if (!func_init_2_or_3(&args, &num_args, DBREF, SYMBOL, LIST))
+	return;
+
+    if (cur_frame->object->dbref != SYSTEM_DBREF) {
+	throw(perm_id, "Current object (#%l) is not the system object.",
+	      cur_frame->object->dbref);
+	return;
+    }
+
+    list = (num_args == 3) ? list_dup(args[2].u.list) : list_new(0);
+    id = make_query(args[0].u.dbref, args[1].u.symbol, list,
+		    cur_frame->object->dbref);
+    list_discard(list);
+    if (id == -1) {
+	throw(query_id, "Couldn't start a query process.");
+    } else {
+	pop(num_args);
+	push_int(id);
+    }
+}
+
+/* Modifies:	The query with the given ID, via cancel_query().
+ * Effects:	If called by the system object, kills a running query.  Its
+ *		receiver gets ~query in place of a result. */
+void op_cancel_query(void)
+{
+    Data *args;
+
+    /* Accept a query ID. */
+    if (!func_init_1(&args, INTEGER))
+	return;
+
+    if (cur_frame->object->dbref != SYSTEM_DBREF) {
+	throw(perm_id, "Current object (#%l) is not the system object.",
+	      cur_frame->object->dbref);
+    } else if (!cancel_query(args[0].u.val)) {
+	throw(query_id, "No running query %l.", args[0].u.val);
+    } else {
+	pop(1);
+	push_int(1);
+    }
+}
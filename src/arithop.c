@@ -118,6 +118,7 @@ void op_add(void)
      * discard d2. */
     if (d1->type == INTEGER && d2->type == INTEGER) {
 	/* Replace d1 with d1 + d2, and pop d2. */
+	quicken(cur_frame->pc - 1, ADD_INT_INT);
 	d1->u.val += d2->u.val;
     } else if (d1->type == STRING && d2->type == STRING) {
 	anticipate_assignment();
@@ -163,6 +164,7 @@ void op_subtract(void)
 	throw(type_id, "Right side (%D) is not an integer.", d2);
     } else {
 	/* Replace d1 with d1 - d2, and pop d2. */
+	quicken(cur_frame->pc - 1, SUBTRACT_INT_INT);
 	d1->u.val -= d2->u.val;
 	pop(1);
     }
@@ -176,6 +178,8 @@ void op_equal(void)
     Data *d2 = &stack[stack_pos - 1];
     int val = (data_cmp(d1, d2) == 0);
 
+    if (d1->type == INTEGER && d2->type == INTEGER)
+	quicken(cur_frame->pc - 1, EQUAL_INT_INT);
     pop(2);
     push_int(val);
 }
@@ -188,6 +192,8 @@ void op_not_equal(void)
     Data *d2 = &stack[stack_pos - 1];
     int val = (data_cmp(d1, d2) != 0);
 
+    if (d1->type == INTEGER && d2->type == INTEGER)
+	quicken(cur_frame->pc - 1, NOT_EQUAL_INT_INT);
     pop(2);
     push_int(val);
 }
@@ -209,6 +215,8 @@ void op_greater(void)
 	throw(type_id, "%D and %D are not integers or strings.", d1, d2);
     } else {
 	/* Discard d1 and d2 and push the appropriate truth value. */
+	if (t == INTEGER)
+	    quicken(cur_frame->pc - 1, GREATER_INT_INT);
 	val = (data_cmp(d1, d2) > 0);
 	pop(2);
 	push_int(val);
@@ -230,6 +238,8 @@ void op_greater_or_equal(void)
 	throw(type_id, "%D and %D are not integers or strings.", d1, d2);
     } else {
 	/* Discard d1 and d2 and push the appropriate truth value. */
+	if (t == INTEGER)
+	    quicken(cur_frame->pc - 1, GREATER_OR_EQUAL_INT_INT);
 	val = (data_cmp(d1, d2) >= 0);
 	pop(2);
 	push_int(val);
@@ -250,6 +260,8 @@ void op_less(void)
 	throw(type_id, "%D and %D are not integers or strings.", d1, d2);
     } else {
 	/* Discard d1 and d2 and push the appropriate truth value. */
+	if (t == INTEGER)
+	    quicken(cur_frame->pc - 1, LESS_INT_INT);
 	val = (data_cmp(d1, d2) < 0);
 	pop(2);
 	push_int(val);
@@ -271,6 +283,8 @@ void op_less_or_equal(void)
 	throw(type_id, "%D and %D are not integers or strings.", d1, d2);
     } else {
 	/* Discard d1 and d2 and push the appropriate truth value. */
+	if (t == INTEGER)
+	    quicken(cur_frame->pc - 1, LESS_OR_EQUAL_INT_INT);
 	val = (data_cmp(d1, d2) <= 0);
 	pop(2);
 	push_int(val);
@@ -311,3 +325,203 @@ void op_in(void)
     push_int(pos + 1);
 }
 
+
+/* The following are superinstructions generated by peephole() in codegen.c
+ * for an operator whose right side is an integer constant.  The constant is
+ * the instruction's argument.  If the left side is an integer, the work is
+ * done in place; otherwise we push the constant and fall back on the general
+ * operator, posing as it so that any error looks the same. */
+
+/* Effects: Adds the argument to the integer on top of the stack. */
+void op_add_integer(void)
+{
+    long n = cur_frame->opcodes[cur_frame->pc++];
+    Data *d = &stack[stack_pos - 1];
+
+    if (d->type == INTEGER) {
+	d->u.val += n;
+    } else {
+	cur_frame->last_opcode = '+';
+	push_int(n);
+	op_add();
+    }
+}
+
+/* Effects: Subtracts the argument from the integer on top of the stack. */
+void op_subtract_integer(void)
+{
+    long n = cur_frame->opcodes[cur_frame->pc++];
+    Data *d = &stack[stack_pos - 1];
+
+    if (d->type == INTEGER) {
+	d->u.val -= n;
+    } else {
+	cur_frame->last_opcode = '-';
+	push_int(n);
+	op_subtract();
+    }
+}
+
+/* Effects: Multiplies the integer on top of the stack by the argument. */
+void op_multiply_integer(void)
+{
+    long n = cur_frame->opcodes[cur_frame->pc++];
+    Data *d = &stack[stack_pos - 1];
+
+    if (d->type == INTEGER) {
+	d->u.val *= n;
+    } else {
+	cur_frame->last_opcode = '*';
+	push_int(n);
+	op_multiply();
+    }
+}
+
+/* Effects: Divides the integer on top of the stack by the argument. */
+void op_divide_integer(void)
+{
+    long n = cur_frame->opcodes[cur_frame->pc++];
+    Data *d = &stack[stack_pos - 1];
+
+    if (d->type == INTEGER && n != 0) {
+	d->u.val /= n;
+    } else {
+	cur_frame->last_opcode = '/';
+	push_int(n);
+	op_divide();
+    }
+}
+
+/* Effects: Replaces the integer on top of the stack with 1 if it is less
+ *	    than the argument, 0 if not. */
+void op_less_integer(void)
+{
+    long n = cur_frame->opcodes[cur_frame->pc++];
+    Data *d = &stack[stack_pos - 1];
+
+    if (d->type == INTEGER) {
+	d->u.val = (d->u.val < n);
+    } else {
+	cur_frame->last_opcode = '<';
+	push_int(n);
+	op_less();
+    }
+}
+
+/* The following are quickened versions of the operators above, which
+ * quicken() installs in place of an instruction's general opcode once it
+ * has seen two integer operands.  Each checks that it still has integers,
+ * and if not, puts back the general opcode and calls its operator.  Integers need
+ * no discarding, so we pop them by moving the stack pointer. */
+
+void op_add_int_int(void)
+{
+    Data *d1 = &stack[stack_pos - 2];
+    Data *d2 = &stack[stack_pos - 1];
+
+    if (d1->type != INTEGER || d2->type != INTEGER) {
+	quicken(cur_frame->pc - 1, '+');
+	op_add();
+	return;
+    }
+    d1->u.val += d2->u.val;
+    stack_pos--;
+}
+
+void op_subtract_int_int(void)
+{
+    Data *d1 = &stack[stack_pos - 2];
+    Data *d2 = &stack[stack_pos - 1];
+
+    if (d1->type != INTEGER || d2->type != INTEGER) {
+	quicken(cur_frame->pc - 1, '-');
+	op_subtract();
+	return;
+    }
+    d1->u.val -= d2->u.val;
+    stack_pos--;
+}
+
+void op_equal_int_int(void)
+{
+    Data *d1 = &stack[stack_pos - 2];
+    Data *d2 = &stack[stack_pos - 1];
+
+    if (d1->type != INTEGER || d2->type != INTEGER) {
+	quicken(cur_frame->pc - 1, EQ);
+	op_equal();
+	return;
+    }
+    d1->u.val = (d1->u.val == d2->u.val);
+    stack_pos--;
+}
+
+void op_not_equal_int_int(void)
+{
+    Data *d1 = &stack[stack_pos - 2];
+    Data *d2 = &stack[stack_pos - 1];
+
+    if (d1->type != INTEGER || d2->type != INTEGER) {
+	quicken(cur_frame->pc - 1, NE);
+	op_not_equal();
+	return;
+    }
+    d1->u.val = (d1->u.val != d2->u.val);
+    stack_pos--;
+}
+
+void op_greater_int_int(void)
+{
+    Data *d1 = &stack[stack_pos - 2];
+    Data *d2 = &stack[stack_pos - 1];
+
+    if (d1->type != INTEGER || d2->type != INTEGER) {
+	quicken(cur_frame->pc - 1, '>');
+	op_greater();
+	return;
+    }
+    d1->u.val = (d1->u.val > d2->u.val);
+    stack_pos--;
+}
+
+void op_greater_or_equal_int_int(void)
+{
+    Data *d1 = &stack[stack_pos - 2];
+    Data *d2 = &stack[stack_pos - 1];
+
+    if (d1->type != INTEGER || d2->type != INTEGER) {
+	quicken(cur_frame->pc - 1, GE);
+	op_greater_or_equal();
+	return;
+    }
+    d1->u.val = (d1->u.val >= d2->u.val);
+    stack_pos--;
+}
+
+void op_less_int_int(void)
+{
+    Data *d1 = &stack[stack_pos - 2];
+    Data *d2 = &stack[stack_pos - 1];
+
+    if (d1->type != INTEGER || d2->type != INTEGER) {
+	quicken(cur_frame->pc - 1, '<');
+	op_less();
+	return;
+    }
+    d1->u.val = (d1->u.val < d2->u.val);
+    stack_pos--;
+}
+
+void op_less_or_equal_int_int(void)
+{
+    Data *d1 = &stack[stack_pos - 2];
+    Data *d2 = &stack[stack_pos - 1];
+
+    if (d1->type != INTEGER || d2->type != INTEGER) {
+	quicken(cur_frame->pc - 1, LE);
+	op_less_or_equal();
+	return;
+    }
+    d1->u.val = (d1->u.val <= d2->u.val);
+    stack_pos--;
+}
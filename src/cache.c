@@ -54,16 +54,22 @@ void init_cache(void)
  * Effects: Returns an object holder linked to the head of the appropriate
  *	    active chain.  Gets the object holder from the tail of the inactive
  *	    chain, swapping out the object there if necessary.  If the inactive
- *	    inactive chain is empty, then we create a new holder. */
+ *	    inactive chain is empty, then we create a new holder.  If the
+ *	    database is read-only, then changed objects can't be swapped out,
+ *	    so we use the clean object nearest the tail instead. */
 Object *cache_get_holder(long dbref)
 {
     int ind = dbref % CACHE_WIDTH;
     Object *obj;
 
-    if (inactive[ind].next != &inactive[ind]) {
-	/* Use the object at the tail of the inactive list. */
-	obj = inactive[ind].prev;
+    /* Use the object at the tail of the inactive list. */
+    obj = inactive[ind].prev;
+    if (db_read_only()) {
+	while (obj != &inactive[ind] && obj->dbref != -1 && obj->dirty)
+	    obj = obj->prev;
+    }
 
+    if (obj != &inactive[ind]) {
 	/* Check if we need to swap anything out. */
 	if (obj->dbref != -1) {
 	    if (obj->dirty) {
@@ -86,6 +86,8 @@ struct stmt {
 	    Stmt *body;
 	} fork;
 
+	Stmt *atomic;
+
     } u;
 };
 
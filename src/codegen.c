@@ -4,6 +4,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include "x.tab.h"
 #include "codegen.h"
 #include "code_prv.h"
@@ -31,6 +32,15 @@ static void compile_cases(Case_list *cases, int loop, int catch_level,
 static void compile_case_values(Expr_list *values, int body_dest);
 static void compile_expr_list(Expr_list *expr_list);
 static void compile_expr(Expr *expr);
+static void fold_stmt_list(Stmt_list *stmt_list);
+static Stmt *fold_stmt(Stmt *stmt);
+static void fold_expr_list(Expr_list *expr_list);
+static Expr *fold_expr(Expr *expr);
+static int max_depth(int a, int b);
+static int stmt_list_depth(Stmt_list *stmt_list);
+static int stmt_depth(Stmt *stmt);
+static int expr_list_depth(Expr_list *expr_list, int *count);
+static int expr_depth(Expr *expr);
 static int find_local_var(char *id);
 static void check_instr_buf(int pos);
 static void code(long val);
@@ -39,6 +49,7 @@ static void code_errors(Id_list *errors);
 static int new_jump_dest(void);
 static void set_jump_dest_here(int dest);
 static int id_list_size(Id_list *id_list);
+static void peephole(void);
 static Method *final_pass(Object *object);
 
 /* Temporary instruction storage. */
@@ -54,6 +65,10 @@ static Prog *the_prog;
 /* Keep track of the number of error lists we'll need. */
 static int num_error_lists;
 
+/* Number of variable and message caches used by the method we're
+ * compiling. */
+static int num_var_caches, num_message_caches;
+
 Pile *compiler_pile;			/* Temporary storage pile. */
 
 /* Requires: Shouldn't be called twice.
@@ -263,6 +278,27 @@ Stmt *catch_stmt(Id_list *errors, Stmt *body, Stmt *handler)
     return new;
 }
 
+Stmt *fork_stmt(Expr *time, Stmt *body)
+{
+    Stmt *new = PMALLOC(compiler_pile, Stmt, 1);
+
+    new->type = FORK;
+    new->lineno = cur_lineno();
+    new->u.fork.time = time;
+    new->u.fork.body = body;
+    return new;
+}
+
+Stmt *atomic_stmt(Stmt *body)
+{
+    Stmt *new = PMALLOC(compiler_pile, Stmt, 1);
+
+    new->type = ATOMIC;
+    new->lineno = cur_lineno();
+    new->u.atomic = body;
+    return new;
+}
+
 Expr *integer_expr(long num)
 {
     Expr *new = PMALLOC(compiler_pile, Expr, 1);
@@ -584,8 +620,10 @@ Case_list *case_list(Case_entry *case_entry, Case_list *next)
  *	    object_add_method(), or NULL if there were errors. */
 Method *generate_method(Prog *prog, Object *object)
 {
-    /* Reset the error list counter to 0. */
+    /* Reset the error list and cache counters to 0. */
     num_error_lists = 0;
+    num_var_caches = 0;
+    num_message_caches = 0;
 
     /* Compile the code into instr_buf. */
     instr_loc = 0;
@@ -593,13 +631,23 @@ Method *generate_method(Prog *prog, Object *object)
     the_prog = prog;
     compile_stmt_list(prog->stmts, -1, 0);
 
-    /* If we have no errors, call final_pass() to make a method. */
-    if (no_errors()) {
-	code(RETURN);
-	return final_pass(object);
-    }
+    if (!no_errors())
+	return NULL;
 
-    return NULL;
+    /* The code compiled as written, so any errors in code which folding
+     * would eliminate have been reported.  Fold constant expressions and
+     * dead branches, and compile the result over the first attempt. */
+    fold_stmt_list(prog->stmts);
+    num_error_lists = 0;
+    num_var_caches = 0;
+    num_message_caches = 0;
+    instr_loc = 0;
+    jump_loc = 0;
+    compile_stmt_list(prog->stmts, -1, 0);
+
+    /* Call final_pass() to make a method. */
+    code(RETURN);
+    return final_pass(object);
 }
 
 /* Requires: Same as compile_stmt() below.
@@ -670,9 +718,10 @@ static void compile_stmt(Stmt *stmt, int loop, int catch_level)
 	      code(n);
 	  } else {
 	      /* This is an object variable.  Code a SET_OBJ_VAR opcode with
-	       * an identifier argument. */
+	       * an identifier argument and a variable cache argument. */
 	      code(SET_OBJ_VAR);
 	      code_str(stmt->u.assign.var);
+	      code(num_var_caches++);
 	  }
 	  break;
       }
@@ -897,8 +946,22 @@ static void compile_stmt(Stmt *stmt, int loop, int catch_level)
 
       case RETURN_EXPR:
 
-	/* Compile the expression to return and code a RETURN_EXPR opcode. */
+	/* Compile the expression to return and code a RETURN_EXPR opcode.  If
+	 * the expression is a message or pass(), change its opcode to the
+	 * tail call version, which can let the new frame replace this one.
+	 * The RETURN_EXPR still runs if it doesn't. */
 	compile_expr(stmt->u.expr);
+	switch (stmt->u.expr->type) {
+	  case PASS:
+	    instr_buf[instr_loc - 1].val = TAIL_PASS;
+	    break;
+	  case MESSAGE:
+	    instr_buf[instr_loc - 3].val = TAIL_MESSAGE;
+	    break;
+	  case EXPR_MESSAGE:
+	    instr_buf[instr_loc - 2].val = TAIL_EXPR_MESSAGE;
+	    break;
+	}
 	code(RETURN_EXPR);
 
 	break;
@@ -940,6 +1003,39 @@ static void compile_stmt(Stmt *stmt, int loop, int catch_level)
 	  break;
       }
 
+      case FORK: {
+	  int end_dest = new_jump_dest();
+
+	  /* Compile the delay, and code a FORK opcode with a jump argument
+	   * pointing past the body.  The new task runs the body and stops at
+	   * the FORK_END opcode after it.  It isn't in any of our loops or
+	   * catch statements. */
+	  compile_expr(stmt->u.fork.time);
+	  code(FORK);
+	  code(end_dest);
+	  compile_stmt(stmt->u.fork.body, -1, 0);
+	  code(FORK_END);
+	  set_jump_dest_here(end_dest);
+
+	  break;
+      }
+
+      case ATOMIC: {
+	  int end_dest = new_jump_dest();
+
+	  /* Code an ATOMIC opcode, with a jump argument pointing past the body
+	   * for the decompiler.  The ATOMIC opcode pushes an error action
+	   * specifier, so a break or continue in the body has one more to pop,
+	   * as in a catch statement. */
+	  code(ATOMIC);
+	  code(end_dest);
+	  compile_stmt(stmt->u.atomic, loop, catch_level + 1);
+	  code(ATOMIC_END);
+	  set_jump_dest_here(end_dest);
+
+	  break;
+      }
+
     }
 }
 
@@ -1017,6 +1113,8 @@ static void compile_expr_list(Expr_list *expr_list)
  * Effects: Compiles expr into instr_buf. */
 static void compile_expr(Expr *expr)
 {
+    unsigned long low;
+
     switch(expr->type) {
 
       case INTEGER:
@@ -1026,6 +1124,13 @@ static void compile_expr(Expr *expr)
 	    code(ZERO);
 	} else if (expr->u.num == 1) {
 	    code(ONE);
+	} else if (expr->u.num != (Opcode) expr->u.num) {
+	    /* Too wide for an opcode argument; code the high and low 32
+	     * bits separately. */
+	    low = (unsigned long) expr->u.num & 0xffffffffUL;
+	    code(BIG_INTEGER);
+	    code((expr->u.num - (long) low) / 65536 / 65536);
+	    code(low);
 	} else {
 	    code(INTEGER);
 	    code(expr->u.num);
@@ -1080,6 +1185,7 @@ static void compile_expr(Expr *expr)
 	  } else {
 	      code(GET_OBJ_VAR);
 	      code_str(expr->u.name);
+	      code(num_var_caches++);
 	  }
 
 	  break;
@@ -1116,6 +1222,7 @@ static void compile_expr(Expr *expr)
 	compile_expr_list(expr->u.message.args);
 	code(MESSAGE);
 	code_str(expr->u.message.name);
+	code(num_message_caches++);
 
 	break;
 
@@ -1126,6 +1233,7 @@ static void compile_expr(Expr *expr)
 	code(START_ARGS);
 	compile_expr_list(expr->u.expr_message.args);
 	code(EXPR_MESSAGE);
+	code(num_message_caches++);
 
 	break;
 
@@ -1323,6 +1431,459 @@ static void compile_expr(Expr *expr)
     }
 }
 
+/* Modifies: The statements in stmt_list.
+ * Effects: Folds the statements in stmt_list; see fold_stmt(). */
+static void fold_stmt_list(Stmt_list *stmt_list)
+{
+    for (; stmt_list; stmt_list = stmt_list->next)
+	stmt_list->stmt = fold_stmt(stmt_list->stmt);
+}
+
+/* Modifies: stmt and the statements and expressions inside it.
+ * Effects: Folds the expressions in stmt, and returns a statement to use in
+ *	    its place.  An if statement with a constant integer condition is
+ *	    replaced by the branch which would run, or becomes a no-op if
+ *	    there isn't one, and a while loop whose condition is a constant
+ *	    zero becomes a no-op. */
+static Stmt *fold_stmt(Stmt *stmt)
+{
+    Expr *cond;
+    Case_list *cases;
+
+    switch (stmt->type) {
+
+      case EXPR:
+      case RETURN_EXPR:
+	stmt->u.expr = fold_expr(stmt->u.expr);
+	break;
+
+      case COMPOUND:
+	fold_stmt_list(stmt->u.stmt_list);
+	break;
+
+      case ASSIGN:
+	stmt->u.assign.value = fold_expr(stmt->u.assign.value);
+	break;
+
+      case IF:
+	cond = stmt->u.if_.cond = fold_expr(stmt->u.if_.cond);
+	stmt->u.if_.true = fold_stmt(stmt->u.if_.true);
+	if (cond->type == INTEGER) {
+	    if (cond->u.num)
+		return stmt->u.if_.true;
+	    stmt->type = NOOP;
+	}
+	break;
+
+      case IF_ELSE:
+	cond = stmt->u.if_.cond = fold_expr(stmt->u.if_.cond);
+	stmt->u.if_.true = fold_stmt(stmt->u.if_.true);
+	stmt->u.if_.false = fold_stmt(stmt->u.if_.false);
+	if (cond->type == INTEGER)
+	    return (cond->u.num) ? stmt->u.if_.true : stmt->u.if_.false;
+	break;
+
+      case FOR_RANGE:
+	stmt->u.for_range.lower = fold_expr(stmt->u.for_range.lower);
+	stmt->u.for_range.upper = fold_expr(stmt->u.for_range.upper);
+	stmt->u.for_range.body = fold_stmt(stmt->u.for_range.body);
+	break;
+
+      case FOR_LIST:
+	stmt->u.for_list.list = fold_expr(stmt->u.for_list.list);
+	stmt->u.for_list.body = fold_stmt(stmt->u.for_list.body);
+	break;
+
+      case WHILE:
+	cond = stmt->u.while_.cond = fold_expr(stmt->u.while_.cond);
+	stmt->u.while_.body = fold_stmt(stmt->u.while_.body);
+	if (cond->type == INTEGER && !cond->u.num)
+	    stmt->type = NOOP;
+	break;
+
+      case SWITCH:
+	stmt->u.switch_.expr = fold_expr(stmt->u.switch_.expr);
+	for (cases = stmt->u.switch_.cases; cases; cases = cases->next) {
+	    fold_expr_list(cases->case_entry->values);
+	    fold_stmt_list(cases->case_entry->stmts);
+	}
+	break;
+
+      case CATCH:
+	stmt->u.catch.body = fold_stmt(stmt->u.catch.body);
+	if (stmt->u.catch.handler)
+	    stmt->u.catch.handler = fold_stmt(stmt->u.catch.handler);
+	break;
+
+      case FORK:
+	stmt->u.fork.time = fold_expr(stmt->u.fork.time);
+	stmt->u.fork.body = fold_stmt(stmt->u.fork.body);
+	break;
+
+      case ATOMIC:
+	stmt->u.atomic = fold_stmt(stmt->u.atomic);
+	break;
+    }
+
+    return stmt;
+}
+
+/* Modifies: The expressions in expr_list.
+ * Effects: Folds each expression in expr_list; see fold_expr(). */
+static void fold_expr_list(Expr_list *expr_list)
+{
+    for (; expr_list; expr_list = expr_list->next)
+	expr_list->expr = fold_expr(expr_list->expr);
+}
+
+/* Modifies: expr and the expressions inside it.
+ * Effects: Returns an expression to use in place of expr.  Operators whose
+ *	    operands are constant integers are evaluated here if they can't
+ *	    fail, as is the addition of two constant strings, and &&, || and
+ *	    ?| expressions with constant integer conditions are replaced by
+ *	    the side which would be evaluated.  Anything else is left for the
+ *	    interpreter, so that its errors happen at run time. */
+static Expr *fold_expr(Expr *expr)
+{
+    Expr *left, *right;
+    long l, r, val;
+    char *s;
+    int len;
+
+    switch (expr->type) {
+
+      case FUNCTION_CALL:
+	fold_expr_list(expr->u.function.args);
+	break;
+
+      case PASS:
+      case LIST:
+      case DICT:
+      case BUFFER:
+	fold_expr_list(expr->u.args);
+	break;
+
+      case MESSAGE:
+	expr->u.message.to = fold_expr(expr->u.message.to);
+	fold_expr_list(expr->u.message.args);
+	break;
+
+      case EXPR_MESSAGE:
+	expr->u.expr_message.to = fold_expr(expr->u.expr_message.to);
+	expr->u.expr_message.message =
+	    fold_expr(expr->u.expr_message.message);
+	fold_expr_list(expr->u.expr_message.args);
+	break;
+
+      case FROB:
+	expr->u.frob.class = fold_expr(expr->u.frob.class);
+	expr->u.frob.rep = fold_expr(expr->u.frob.rep);
+	break;
+
+      case INDEX:
+	expr->u.index.list = fold_expr(expr->u.index.list);
+	expr->u.index.offset = fold_expr(expr->u.index.offset);
+	break;
+
+      case UNARY:
+	left = expr->u.unary.expr = fold_expr(expr->u.unary.expr);
+	if (left->type != INTEGER)
+	    break;
+	if (expr->u.unary.opcode == NEG) {
+	    /* -LONG_MIN overflows; leave it to run time. */
+	    if (left->u.num == LONG_MIN)
+		break;
+	    val = -left->u.num;
+	} else {
+	    val = !left->u.num;
+	}
+	expr->type = INTEGER;
+	expr->u.num = val;
+	break;
+
+      case BINARY:
+	left = expr->u.binary.left = fold_expr(expr->u.binary.left);
+	right = expr->u.binary.right = fold_expr(expr->u.binary.right);
+
+	if (left->type == STRING && right->type == STRING
+	    && expr->u.binary.opcode == '+') {
+	    len = strlen(left->u.str);
+	    s = PMALLOC(compiler_pile, char, len + strlen(right->u.str) + 1);
+	    strcpy(s, left->u.str);
+	    strcpy(s + len, right->u.str);
+	    expr->type = STRING;
+	    expr->u.str = s;
+	    break;
+	}
+
+	if (left->type != INTEGER || right->type != INTEGER)
+	    break;
+	l = left->u.num;
+	r = right->u.num;
+
+	switch (expr->u.binary.opcode) {
+	  case '*':	val = l * r;	break;
+	  case '+':	val = l + r;	break;
+	  case '-':	val = l - r;	break;
+	  case EQ:	val = (l == r);	break;
+	  case NE:	val = (l != r);	break;
+	  case '>':	val = (l > r);	break;
+	  case GE:	val = (l >= r);	break;
+	  case '<':	val = (l < r);	break;
+	  case LE:	val = (l <= r);	break;
+
+	  case '/':
+	  case '%':
+	    /* Leave division by zero to raise ~div at run time.  LONG_MIN
+	     * divided by -1 overflows. */
+	    if (!r || (l == LONG_MIN && r == -1))
+		return expr;
+	    val = (expr->u.binary.opcode == '/') ? l / r : l % r;
+	    break;
+
+	  default:
+	    return expr;
+	}
+	expr->type = INTEGER;
+	expr->u.num = val;
+	break;
+
+      case AND:
+	left = expr->u.and.left = fold_expr(expr->u.and.left);
+	expr->u.and.right = fold_expr(expr->u.and.right);
+	if (left->type == INTEGER)
+	    return (left->u.num) ? expr->u.and.right : left;
+	break;
+
+      case OR:
+	left = expr->u.or.left = fold_expr(expr->u.or.left);
+	expr->u.or.right = fold_expr(expr->u.or.right);
+	if (left->type == INTEGER)
+	    return (left->u.num) ? left : expr->u.or.right;
+	break;
+
+      case CONDITIONAL:
+	left = expr->u.cond.cond = fold_expr(expr->u.cond.cond);
+	expr->u.cond.true = fold_expr(expr->u.cond.true);
+	expr->u.cond.false = fold_expr(expr->u.cond.false);
+	if (left->type == INTEGER)
+	    return (left->u.num) ? expr->u.cond.true : expr->u.cond.false;
+	break;
+
+      case CRITICAL:
+      case PROPAGATE:
+      case SPLICE:
+	expr->u.expr = fold_expr(expr->u.expr);
+	break;
+
+      case RANGE:
+	expr->u.range.lower = fold_expr(expr->u.range.lower);
+	expr->u.range.upper = fold_expr(expr->u.range.upper);
+	break;
+    }
+
+    return expr;
+}
+
+/* Effects: Returns the larger of two stack depths. */
+static int max_depth(int a, int b)
+{
+    return (a > b) ? a : b;
+}
+
+/* Effects: Returns the number of stack slots the statements in stmt_list
+ *	    need above the local variables; see stmt_depth(). */
+static int stmt_list_depth(Stmt_list *stmt_list)
+{
+    int depth = 0, n;
+
+    for (; stmt_list; stmt_list = stmt_list->next) {
+	n = stmt_depth(stmt_list->stmt);
+	if (n > depth)
+	    depth = n;
+    }
+    return depth;
+}
+
+/* Effects: Returns the largest number of stack slots the code compiled for
+ *	    stmt can use above the local variables.  Loops keep two slots of
+ *	    state on the stack while their bodies run, and a switch keeps its
+ *	    controlling value while the cases are tested. */
+static int stmt_depth(Stmt *stmt)
+{
+    Case_list *cases;
+    Expr_list *values;
+    int depth, n;
+
+    switch (stmt->type) {
+
+      case EXPR:
+      case RETURN_EXPR:
+	return expr_depth(stmt->u.expr);
+
+      case COMPOUND:
+	return stmt_list_depth(stmt->u.stmt_list);
+
+      case ASSIGN:
+	return expr_depth(stmt->u.assign.value);
+
+      case IF:
+	return max_depth(expr_depth(stmt->u.if_.cond),
+			 stmt_depth(stmt->u.if_.true));
+
+      case IF_ELSE:
+	depth = max_depth(stmt_depth(stmt->u.if_.true),
+			  stmt_depth(stmt->u.if_.false));
+	return max_depth(expr_depth(stmt->u.if_.cond), depth);
+
+      case FOR_RANGE:
+	depth = max_depth(expr_depth(stmt->u.for_range.lower),
+			  1 + expr_depth(stmt->u.for_range.upper));
+	return max_depth(depth, 2 + stmt_depth(stmt->u.for_range.body));
+
+      case FOR_LIST:
+	depth = max_depth(expr_depth(stmt->u.for_list.list), 2);
+	return max_depth(depth, 2 + stmt_depth(stmt->u.for_list.body));
+
+      case WHILE:
+	return max_depth(expr_depth(stmt->u.while_.cond),
+			 stmt_depth(stmt->u.while_.body));
+
+      case SWITCH:
+	depth = expr_depth(stmt->u.switch_.expr);
+	for (cases = stmt->u.switch_.cases; cases; cases = cases->next) {
+	    for (values = cases->case_entry->values; values;
+		 values = values->next) {
+		n = 1 + expr_depth(values->expr);
+		depth = max_depth(depth, n);
+	    }
+	    n = 1 + stmt_list_depth(cases->case_entry->stmts);
+	    depth = max_depth(depth, n);
+	}
+	return depth;
+
+      case CATCH:
+	depth = stmt_depth(stmt->u.catch.body);
+	if (stmt->u.catch.handler)
+	    depth = max_depth(depth, stmt_depth(stmt->u.catch.handler));
+	return depth;
+
+      case FORK:
+	return max_depth(expr_depth(stmt->u.fork.time),
+			 stmt_depth(stmt->u.fork.body));
+
+      case ATOMIC:
+	return stmt_depth(stmt->u.atomic);
+
+      default:
+	return 0;
+    }
+}
+
+/* Effects: Returns the number of stack slots needed to evaluate the
+ *	    arguments in expr_list and call a function on them, and sets
+ *	    *count to the number of arguments.  The list is in reverse order,
+ *	    like it is for compile_expr_list().  A function may push its
+ *	    result before popping its arguments, so we allow one slot past
+ *	    the last argument. */
+static int expr_list_depth(Expr_list *expr_list, int *count)
+{
+    int depth, n;
+
+    if (!expr_list) {
+	*count = 0;
+	return 1;
+    }
+    depth = expr_list_depth(expr_list->next, count);
+    n = *count + expr_depth(expr_list->expr);
+    (*count)++;
+    return max_depth(depth, max_depth(n, *count + 1));
+}
+
+/* Effects: Returns the largest number of stack slots the code compiled for
+ *	    expr can use, including the slot for its value.  Splices can go
+ *	    past this; op_splice() makes room for what they add. */
+static int expr_depth(Expr *expr)
+{
+    Expr_list **elistp, *elist;
+    int depth, count;
+
+    switch (expr->type) {
+
+      case FUNCTION_CALL:
+	return expr_list_depth(expr->u.function.args, &count);
+
+      case PASS:
+      case DICT:
+      case BUFFER:
+	return expr_list_depth(expr->u.args, &count);
+
+      case MESSAGE:
+	return max_depth(expr_depth(expr->u.message.to),
+			 1 + expr_list_depth(expr->u.message.args, &count));
+
+      case EXPR_MESSAGE:
+	depth = max_depth(expr_depth(expr->u.expr_message.to),
+			  1 + expr_depth(expr->u.expr_message.message));
+	return max_depth(depth,
+			 2 + expr_list_depth(expr->u.expr_message.args,
+						 &count));
+
+      case LIST:
+	/* Mirror the SPLICE_ADD case in compile_expr(). */
+	elistp = &expr->u.args;
+	while (*elistp && (*elistp)->next)
+	    elistp = &(*elistp)->next;
+	if (*elistp && (*elistp)->expr->type == SPLICE) {
+	    elist = *elistp;
+	    *elistp = NULL;
+	    depth = 1 + expr_list_depth(expr->u.args, &count);
+	    *elistp = elist;
+	    return max_depth(expr_depth(elist->expr->u.expr), depth);
+	}
+	return expr_list_depth(expr->u.args, &count);
+
+      case FROB:
+	return max_depth(expr_depth(expr->u.frob.class),
+			 1 + expr_depth(expr->u.frob.rep));
+
+      case INDEX:
+	return max_depth(expr_depth(expr->u.index.list),
+			 1 + expr_depth(expr->u.index.offset));
+
+      case UNARY:
+	return expr_depth(expr->u.unary.expr);
+
+      case BINARY:
+	/* A fused integer instruction may push its constant to fall back on
+	 * the general operator, which the right side's slot covers. */
+	return max_depth(expr_depth(expr->u.binary.left),
+			 1 + expr_depth(expr->u.binary.right));
+
+      case AND:
+      case OR:
+	return max_depth(expr_depth(expr->u.and.left),
+			 expr_depth(expr->u.and.right));
+
+      case CONDITIONAL:
+	depth = max_depth(expr_depth(expr->u.cond.true),
+			  expr_depth(expr->u.cond.false));
+	return max_depth(expr_depth(expr->u.cond.cond), depth);
+
+      case CRITICAL:
+      case PROPAGATE:
+      case SPLICE:
+	return expr_depth(expr->u.expr);
+
+      case RANGE:
+	return max_depth(expr_depth(expr->u.range.lower),
+			 1 + expr_depth(expr->u.range.upper));
+
+      default:
+	return 1;
+    }
+}
+
 /* Effects: Returns the number of id as a local variable, or -1 if it doesn't
  *	    match any of the local variable names. */
 static int find_local_var(char *id)
@@ -1430,6 +1991,97 @@ static int id_list_size(Id_list *id_list)
     return count;
 }
 
+/* Operators which peephole() can combine with a preceding integer constant,
+ * and the superinstructions it replaces them with. */
+static struct {
+    int opcode;
+    int integer_opcode;
+} integer_ops[] = {
+    { '+',	ADD_INTEGER },
+    { '-',	SUBTRACT_INTEGER },
+    { '*',	MULTIPLY_INTEGER },
+    { '/',	DIVIDE_INTEGER },
+    { '<',	LESS_INTEGER }
+};
+
+#define NUM_INTEGER_OPS ((int) (sizeof(integer_ops) / sizeof(*integer_ops)))
+
+/* Requires: The instruction buffer is full of code, and jump_table holds
+ *	     instruction buffer positions.
+ * Modifies: instr_buf, instr_loc, contents of jump_table.
+ * Effects: Replaces common pairs of instructions with superinstructions,
+ *	    which do the work of both with one dispatch: two GET_LOCALs
+ *	    become a GET_LOCAL_LOCAL, and an integer constant followed by one
+ *	    of the operators in integer_ops becomes a single instruction with
+ *	    the constant as its argument.  A pair is left alone if anything
+ *	    jumps to its second instruction.  Code is compacted in place, and
+ *	    jump destinations are moved along with it. */
+static void peephole(void)
+{
+    char *target;
+    int *map;
+    int r, w, i, len, opcode, next;
+    long val;
+    Op_info *info;
+
+    /* Mark the positions which are jump destinations. */
+    target = PMALLOC(compiler_pile, char, instr_loc + 1);
+    memset(target, 0, instr_loc + 1);
+    for (i = 0; i < jump_loc; i++)
+	target[jump_table[i]] = 1;
+
+    /* map[r] will hold the new position of the instruction at r. */
+    map = PMALLOC(compiler_pile, int, instr_loc + 1);
+
+    r = w = 0;
+    while (r < instr_loc) {
+	map[r] = w;
+	opcode = instr_buf[r].val;
+	info = &op_table[opcode];
+	len = 1 + (info->arg1 != 0) + (info->arg2 != 0);
+
+	next = (r + len < instr_loc && !target[r + len])
+	       ? instr_buf[r + len].val : -1;
+
+	if (opcode == GET_LOCAL && next == GET_LOCAL) {
+	    val = instr_buf[r + 3].val;
+	    instr_buf[w].val = GET_LOCAL_LOCAL;
+	    instr_buf[w + 1].val = instr_buf[r + 1].val;
+	    instr_buf[w + 2].val = val;
+	    r += 4;
+	    w += 3;
+	    continue;
+	}
+
+	if (opcode == INTEGER || opcode == ZERO || opcode == ONE) {
+	    for (i = 0; i < NUM_INTEGER_OPS; i++) {
+		if (integer_ops[i].opcode == next)
+		    break;
+	    }
+	    if (i < NUM_INTEGER_OPS) {
+		if (opcode == INTEGER)
+		    val = instr_buf[r + 1].val;
+		else
+		    val = (opcode == ONE);
+		instr_buf[w].val = integer_ops[i].integer_opcode;
+		instr_buf[w + 1].val = val;
+		r += len + 1;
+		w += 2;
+		continue;
+	    }
+	}
+
+	/* Copy the instruction as it is. */
+	for (i = 0; i < len; i++)
+	    instr_buf[w++] = instr_buf[r++];
+    }
+    map[instr_loc] = w;
+
+    for (i = 0; i < jump_loc; i++)
+	jump_table[i] = map[jump_table[i]];
+    instr_loc = w;
+}
+
 /* Requires: The instruction buffer is full of code.  The method did not have
  *	     any errors.  the_prog->vars is what it originally was.
  * Modifies: Adds global identifiers, adds strings to object.
@@ -1470,14 +2122,24 @@ static Method *final_pass(Object *object)
 	    method->varnames[i++] = object_add_ident(object, idl->ident);
     }
 
+    /* Record how much stack the method needs, so that frame_start() can
+     * reserve it and pushes needn't check. */
+    method->max_stack = stmt_list_depth(the_prog->stmts);
+
+    method->num_var_caches = num_var_caches;
+    method->num_message_caches = num_message_caches;
+
     /* Allocate space for error lists, and initialize cur_error_list. */
     method->num_error_lists = num_error_lists;
     if (num_error_lists)
 	method->error_lists = TMALLOC(Error_list, num_error_lists);
     cur_error_list = 0;
 
+    /* Combine common instruction pairs before copying. */
+    peephole();
+
     /* Copy the opcodes, translating from intermediate instruction forms. */
-    method->opcodes = TMALLOC(long, instr_loc);
+    method->opcodes = TMALLOC(Opcode, instr_loc);
     method->num_opcodes = instr_loc;
     i = 0;
     while (i < instr_loc) {
@@ -1545,6 +2207,9 @@ static Method *final_pass(Object *object)
 	i++;
     }
 
+    /* Allocate empty variable and message caches, and thread the code. */
+    method_prepare(method);
+
     method->refs = 1;
     return method;
 }
@@ -41,6 +41,8 @@ Stmt *continue_stmt(void);
 Stmt *return_stmt(void);
 Stmt *return_expr_stmt(Expr *expr);
 Stmt *catch_stmt(Id_list *errors, Stmt *body, Stmt *handler);
+Stmt *fork_stmt(Expr *time, Stmt *body);
+Stmt *atomic_stmt(Stmt *body);
 
 Expr *integer_expr(long num);
 Expr *string_expr(char *str);
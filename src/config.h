@@ -6,17 +6,35 @@
 /* Uses vfork() instead of fork() in adminop.c. */
 /* #define BSD_FEATURES */
 
+/* Dispatches instructions in execute() with computed gotos, a GNU C
+ * extension.  Other compilers use a loop which calls through op_table. */
+#define THREADED_DISPATCH
+
 /* The version number. */
 #define VERSION_MAJOR	0
 #define VERSION_MINOR	11
 #define VERSION_BUGFIX	0
 
+/* The version of the binary database format.  Bump it when the way objects
+ * are stored changes; a binary database in another format is refused. */
+#define DB_FORMAT	5
+
 /* Number of ticks a method gets before dying with an E_TICKS. */
 #define METHOD_TICKS		20000
 
+/* Number of ticks a task runs before other tasks and I/O get a turn. */
+#define TASK_SLICE		50000
+
+/* Number of seconds a query process can run before it is killed. */
+#define QUERY_TIMEOUT		60
+
 /* Maximum depth of method calls. */
 #define MAX_CALL_DEPTH		128
 
+/* Maximum number of frames a task can replace through tail calls.  Each is
+ * remembered for tracebacks.  Past this, a tail call nests like any other. */
+#define MAX_TAIL_CALLS		10000
+
 /* Width and depth of object cache. */
 #define CACHE_WIDTH	7
 #define CACHE_DEPTH	23
@@ -31,7 +31,9 @@ int data_cmp(Data *d1, Data *d2)
     switch (d1->type) {
 
       case INTEGER:
-	return d1->u.val - d2->u.val;
+	/* Don't subtract; the difference of two longs may not fit in an
+	 * int. */
+	return (d1->u.val > d2->u.val) - (d1->u.val < d2->u.val);
 
       case STRING:
 	return strccmp(string_chars(d1->u.str), string_chars(d2->u.str));
@@ -128,10 +130,10 @@ unsigned long data_hash(Data *d)
 	    return 100;
 
       case SYMBOL:
-	return hash(ident_name(d->u.symbol));
+	return ident_hash(d->u.symbol);
 
       case ERROR:
-	return hash(ident_name(d->u.error));
+	return ident_hash(d->u.error);
 
       case FROB:
 	return d->u.frob->class + data_hash(&d->u.frob->rep);
@@ -385,7 +387,7 @@ char *data_from_literal(Data *d, char *s)
 
     d->type = -1;
 
-    if (isdigit(*s)) {
+    if (isdigit(*s) || (*s == '-' && isdigit(s[1]))) {
 	d->type = INTEGER;
 	d->u.val = atol(s);
 	while (isdigit(*++s));
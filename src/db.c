@@ -30,6 +30,10 @@
 #define	LOGICAL_BLOCK(off)	((off) / BLOCK_SIZE)
 #define	BLOCK_OFFSET(block)	((block) * BLOCK_SIZE)
 
+/* We use MALLOC_DELTA to keep the identifier dictionary tables at least 32
+ * bytes below a power of two, assuming a long is four bytes. */
+#define MALLOC_DELTA		8
+
 #ifdef S_IRUSR
 #define READ_WRITE		(S_IRUSR | S_IWUSR)
 #define READ_WRITE_EXECUTE	(S_IRUSR | S_IWUSR | S_IXUSR)
@@ -44,6 +48,9 @@ static void grow_bitmap(int new_blocks);
 static int db_alloc(int size);
 static void db_is_clean(void);
 static void db_is_dirty(void);
+static void read_ident_dict(void);
+static void add_dict_entry(Ident id);
+static void db_defer_unmark(off_t offset, int size, int dead);
 
 static int last_free = 0;	/* Last known or suspected free block */
 
@@ -54,6 +61,31 @@ static int bitmap_blocks = 0;
 
 static int db_clean;
 
+/* While the database is frozen, blocks which objects move out of or which
+ * deleted objects leave are kept here until it thaws, so that objects a
+ * query process can still see aren't written over.  In a query process, the
+ * database is read-only. */
+static struct freed_extent {
+    off_t offset;
+    int size;
+    int dead;
+} *freed;
+static int freed_count = 0, freed_size = 0;
+static int frozen = 0, read_only = 0;
+
+/* The identifier dictionary maps small numbers to identifiers for the whole
+ * database.  Objects refer to identifiers by dictionary number, so loading
+ * an object doesn't have to look up every identifier by name.  The
+ * dictionary keeps a reference to each identifier it contains, so an
+ * identifier's number in the global table never changes while it's in the
+ * dictionary.  ident_nums maps the other way, from identifiers to
+ * dictionary numbers, or -1 if the identifier isn't in the dictionary. */
+static FILE *ident_file = NULL;
+static Ident *ident_dict = NULL;
+static long ident_dict_size = 0, ident_dict_count = 0;
+static long *ident_nums = NULL;
+static long ident_nums_size = 0;
+
 extern long cur_search, db_top;
 
 int init_db(void)
@@ -87,16 +119,31 @@ int init_db(void)
 		    new = 0;
 		    fgets(buf, 80, fp);
 		    cur_search = atoi(buf);
+		    if (!fgets(buf, 80, fp) || atoi(buf) != DB_FORMAT)
+			fail_to_start("Binary database is in another format.  "
+				      "Move it aside to load the text dump.");
 		}
 	    }
 	}
 	fclose(fp);
     }
 
+    /* An existing database is useless without its identifier dictionary, but
+     * don't throw it away. */
+    if (!new && stat("binary/idents", &statbuf) == -1)
+	fail_to_start("Binary database has no identifier dictionary.");
+
     database_file = fopen("binary/objects", (new) ? "w+" : "r+");
     if (!database_file)
 	fail_to_start("Cannot open object database file.");
 
+    /* Open and load the identifier dictionary. */
+    ident_file = fopen("binary/idents", (new) ? "w+" : "r+");
+    if (!ident_file)
+	fail_to_start("Cannot open identifier dictionary file.");
+    if (!new)
+	read_ident_dict();
+
     /* Open hash table. */
     lookup_open("binary/index", new);
 
@@ -232,10 +279,16 @@ int db_put(Object *obj, long dbref)
     off_t old_offset, new_offset;
     int old_size, new_size = size_object(obj);
 
+    if (read_only)
+	return 0;
+
     db_is_dirty();
 
     if (lookup_retrieve_dbref(dbref, &old_offset, &old_size)) {
-	if (NEEDED(new_size, BLOCK_SIZE) > NEEDED(old_size, BLOCK_SIZE)) {
+	if (frozen) {
+	    db_defer_unmark(old_offset, old_size, 0);
+	    new_offset = BLOCK_OFFSET(db_alloc(new_size));
+	} else if (NEEDED(new_size, BLOCK_SIZE) > NEEDED(old_size, BLOCK_SIZE)) {
 	    db_unmark(LOGICAL_BLOCK(old_offset), old_size);
 	    new_offset = BLOCK_OFFSET(db_alloc(new_size));
 	} else {
@@ -254,6 +307,9 @@ int db_put(Object *obj, long dbref)
     }
 
     pack_object(obj, database_file);
+
+    /* Flush any new dictionary entries before the object which uses them. */
+    fflush(ident_file);
     fflush(database_file);
 
     return 1;
@@ -282,6 +338,11 @@ int db_del(long dbref)
 
     db_is_dirty();
 
+    if (frozen) {
+	db_defer_unmark(offset, size, 1);
+	return 1;
+    }
+
     /* Mark free space in bitmap */
     db_unmark(LOGICAL_BLOCK(offset), size);
 
@@ -301,6 +362,7 @@ void db_close(void)
 {
     lookup_close();
     fclose(database_file);
+    fclose(ident_file);
     free(bitmap);
     db_is_clean();
 }
@@ -308,9 +370,81 @@ void db_close(void)
 void db_flush(void)
 {
     lookup_sync();
+    fflush(ident_file);
     db_is_clean();
 }
 
+/* Modifies:	The database files.
+ * Effects:	Writes out buffered changes to the database files and freezes
+ *		them, so that they don't change on disk until db_thaw() has
+ *		been called once for each call to db_freeze().  Meanwhile,
+ *		objects which are written go in free blocks, and changes to
+ *		the index wait in memory. */
+void db_freeze(void)
+{
+    if (frozen++)
+	return;
+    fflush(ident_file);
+    fflush(database_file);
+    lookup_freeze();
+}
+
+/* Modifies:	The database files.
+ * Effects:	Undoes one call to db_freeze(), writing out the changes made
+ *		while the database was frozen if it was the last. */
+void db_thaw(void)
+{
+    int i;
+
+    if (--frozen)
+	return;
+
+    lookup_thaw();
+    for (i = 0; i < freed_count; i++) {
+	db_unmark(LOGICAL_BLOCK(freed[i].offset), freed[i].size);
+	if (freed[i].dead && !fseek(database_file, freed[i].offset, SEEK_SET))
+	    fputs("delobj", database_file);
+    }
+    fflush(database_file);
+    freed_count = 0;
+}
+
+/* Effects:	Returns nonzero if objects can't be written to the database. */
+int db_read_only(void)
+{
+    return read_only;
+}
+
+/* Requires:	The database is frozen, and we are in a query process.
+ * Modifies:	The database state.
+ * Effects:	Opens the database files again read-only, without closing the
+ *		streams which share file offsets with the server, so that we
+ *		read the database as it was when it was frozen.  The database
+ *		stays frozen for good. */
+void db_snapshot(void)
+{
+    database_file = fopen("binary/objects", "r");
+    if (!database_file)
+	panic("Cannot reopen object database file.");
+    lookup_snapshot();
+    read_only = 1;
+
+    /* The 'clean' file is the server's business. */
+    db_clean = 0;
+}
+
+static void db_defer_unmark(off_t offset, int size, int dead)
+{
+    if (freed_count == freed_size) {
+	freed_size = freed_size * 2 + MALLOC_DELTA;
+	freed = EREALLOC(freed, struct freed_extent, freed_size);
+    }
+    freed[freed_count].offset = offset;
+    freed[freed_count].size = size;
+    freed[freed_count].dead = dead;
+    freed_count++;
+}
+
 static void db_is_clean(void)
 {
     FILE *fp;
@@ -325,6 +459,7 @@ static void db_is_clean(void)
 
     fformat(fp, "%d\n%d\n%d\n", VERSION_MAJOR, VERSION_MINOR, VERSION_BUGFIX);
     fformat(fp, "%l\n", cur_search);
+    fformat(fp, "%d\n", DB_FORMAT);
     close_scratch_file(fp);
     db_clean = 1;
 }
@@ -339,3 +474,89 @@ static void db_is_dirty(void)
     }
 }
 
+
+/* Make room in the dictionary for size identifiers.  ident.c calls this
+ * whenever the global identifier table grows.  Each dictionary entry holds a
+ * different identifier, so the dictionary never outgrows the global table,
+ * and adding to it while objects are written out never allocates memory. */
+void db_reserve_idents(long size)
+{
+    long i;
+
+    if (size <= ident_nums_size)
+	return;
+    ident_dict = EREALLOC(ident_dict, Ident, size);
+    ident_dict_size = size;
+    ident_nums = EREALLOC(ident_nums, long, size);
+    for (i = ident_nums_size; i < size; i++)
+	ident_nums[i] = -1;
+    ident_nums_size = size;
+}
+
+/* Return the dictionary number for id, adding id to the dictionary if it isn't
+ * there already. */
+long db_ident_num(Ident id)
+{
+    char *s;
+    int len;
+
+    if (id < ident_nums_size && ident_nums[id] != -1)
+	return ident_nums[id];
+
+    /* Append the identifier to the dictionary file. */
+    s = ident_name(id);
+    len = strlen(s);
+    fseek(ident_file, 0, SEEK_END);
+    write_long(len, ident_file);
+    fwrite(s, sizeof(char), len, ident_file);
+
+    add_dict_entry(ident_dup(id));
+    return ident_dict_count - 1;
+}
+
+/* Return the dictionary number for id, or if it isn't in the dictionary, a
+ * number at least as large as the one it will get.  Doesn't change the
+ * dictionary, so that sizing an object has no side effects. */
+long db_ident_num_bound(Ident id)
+{
+    if (id < ident_nums_size && ident_nums[id] != -1)
+	return ident_nums[id];
+    return ident_dict_size;
+}
+
+/* Return the identifier with dictionary number num.  Does not duplicate the
+ * identifier.  A number outside the dictionary means the object we're reading
+ * came from a corrupt or foreign database. */
+Ident db_ident(long num)
+{
+    if (num < 0 || num >= ident_dict_count)
+	panic("Identifier number out of range in database.");
+    return ident_dict[num];
+}
+
+static void read_ident_dict(void)
+{
+    int c, len;
+    char *s;
+
+    while ((c = getc(ident_file)) != EOF) {
+	ungetc(c, ident_file);
+
+	/* Read the identifier into temporary storage. */
+	len = read_long(ident_file);
+	s = TMALLOC(char, len + 1);
+	fread(s, sizeof(char), len, ident_file);
+	s[len] = 0;
+
+	/* The dictionary keeps the reference we get from ident_get(). */
+	add_dict_entry(ident_get(s));
+	tfree_chars(s);
+    }
+}
+
+/* Add id to the end of the dictionary.  Takes control of a reference to id. */
+static void add_dict_entry(Ident id)
+{
+    ident_dict[ident_dict_count] = id;
+    ident_nums[id] = ident_dict_count++;
+}
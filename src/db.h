@@ -3,6 +3,7 @@
 #ifndef DBMCHUNK_H
 #define DBMCHUNK_H
 #include "object.h"
+#include "ident.h"
 
 int init_db(void);
 int db_get(Object *object, long name);
@@ -14,6 +15,14 @@ char *db_traverse_next(void);
 int db_backup(char *out);
 void db_close(void);
 void db_flush(void);
+void db_freeze(void);
+void db_thaw(void);
+int db_read_only(void);
+void db_snapshot(void);
+void db_reserve_idents(long size);
+long db_ident_num(Ident id);
+long db_ident_num_bound(Ident id);
+Ident db_ident(long num);
 
 #endif
 
@@ -11,10 +11,12 @@
 #include "memory.h"
 #include "cmstring.h"
 #include "ident.h"
+#include "db.h"
 
 static void pack_list(List *list, FILE *fp);
 static void pack_dict(Dict *dict, FILE *fp);
 static void pack_data(Data *data, FILE *fp);
+static void pack_children(Object *obj, FILE *fp);
 static void pack_vars(Object *obj, FILE *fp);
 static void pack_methods(Object *obj, FILE *fp);
 static void pack_method(Method *method, FILE *fp);
@@ -24,6 +26,7 @@ static void pack_idents(Object *obj, FILE *fp);
 static List *unpack_list(FILE *fp);
 static Dict *unpack_dict(FILE *fp);
 static void unpack_data(Data *data, FILE *fp);
+static void unpack_children(Object *obj, FILE *fp);
 static void unpack_vars(Object *obj, FILE *fp);
 static void unpack_methods(Object *obj, FILE *fp);
 static Method *unpack_method(FILE *fp);
@@ -33,6 +36,7 @@ static void unpack_idents(Object *obj, FILE *fp);
 static int size_list(List *list);
 static int size_dict(Dict *dict);
 static int size_data(Data *data);
+static int size_children(Object *obj);
 static int size_vars(Object *obj);
 static int size_methods(Object *obj);
 static int size_method(Method *method);
@@ -46,7 +50,7 @@ static long size_ident(long id);
 void pack_object(Object *obj, FILE *fp)
 {
     pack_list(obj->parents, fp);
-    pack_list(obj->children, fp);
+    pack_children(obj, fp);
     pack_vars(obj, fp);
     pack_methods(obj, fp);
     pack_strings(obj, fp);
@@ -87,6 +91,7 @@ static void pack_data(Data *data, FILE *fp)
 
       case STRING:
 	string_pack(data->u.str, fp);
+	break;
 
       case DBREF:
 	write_long(data->u.dbref, fp);
@@ -124,6 +129,25 @@ static void pack_data(Data *data, FILE *fp)
     }
 }
 
+static void pack_children(Object *obj, FILE *fp)
+{
+    int i;
+
+    write_long(obj->children.size, fp);
+    write_long(obj->children.blanks, fp);
+    write_long(obj->children.first, fp);
+    write_long(obj->children.last, fp);
+    write_long(obj->children.num, fp);
+
+    for (i = 0; i < obj->children.size; i++) {
+	write_long(obj->children.hashtab[i], fp);
+	write_long(obj->children.tab[i].dbref, fp);
+	write_long(obj->children.tab[i].next, fp);
+	write_long(obj->children.tab[i].prev_added, fp);
+	write_long(obj->children.tab[i].next_added, fp);
+    }
+}
+
 static void pack_vars(Object *obj, FILE *fp)
 {
     int i;
@@ -135,7 +159,7 @@ static void pack_vars(Object *obj, FILE *fp)
 	write_long(obj->vars.hashtab[i], fp);
 	if (obj->vars.tab[i].name != NOT_AN_IDENT) {
 	    write_ident(obj->vars.tab[i].name, fp);
-	    write_ident(obj->vars.tab[i].class, fp);
+	    write_long(obj->vars.tab[i].class, fp);
 	    pack_data(&obj->vars.tab[i].val, fp);
 	} else {
 	    write_long(NOT_AN_IDENT, fp);
@@ -177,11 +201,15 @@ static void pack_method(Method *method, FILE *fp)
     write_long(method->num_vars, fp);
     for (i = 0; i < method->num_vars; i++)
 	write_long(method->varnames[i], fp);
+    write_long(method->max_stack, fp);
 
     write_long(method->num_opcodes, fp);
     for (i = 0; i < method->num_opcodes; i++)
 	write_long(method->opcodes[i], fp);
 
+    write_long(method->num_var_caches, fp);
+    write_long(method->num_message_caches, fp);
+
     write_long(method->num_error_lists, fp);
     for (i = 0; i < method->num_error_lists; i++) {
 	write_long(method->error_lists[i].num_errors, fp);
@@ -224,7 +252,7 @@ static void pack_idents(Object *obj, FILE *fp)
 void unpack_object(Object *obj, FILE *fp)
 {
     obj->parents = unpack_list(fp);
-    obj->children = unpack_list(fp);
+    unpack_children(obj, fp);
     unpack_vars(obj, fp);
     unpack_methods(obj, fp);
     unpack_strings(obj, fp);
@@ -295,6 +323,7 @@ static void unpack_data(Data *data, FILE *fp)
 	break;
 
       case FROB:
+	data->u.frob = TMALLOC(Frob, 1);
 	data->u.frob->class = read_long(fp);
 	unpack_data(&data->u.frob->rep, fp);
 	break;
@@ -315,6 +344,35 @@ static void unpack_data(Data *data, FILE *fp)
     }
 }
 
+static void unpack_children(Object *obj, FILE *fp)
+{
+    int i;
+
+    obj->children.size = read_long(fp);
+    obj->children.blanks = read_long(fp);
+    obj->children.first = read_long(fp);
+    obj->children.last = read_long(fp);
+    obj->children.num = read_long(fp);
+    obj->children.list = NULL;
+
+    if (!obj->children.size) {
+	obj->children.tab = NULL;
+	obj->children.hashtab = NULL;
+	return;
+    }
+
+    obj->children.hashtab = EMALLOC(int, obj->children.size);
+    obj->children.tab = EMALLOC(struct child, obj->children.size);
+
+    for (i = 0; i < obj->children.size; i++) {
+	obj->children.hashtab[i] = read_long(fp);
+	obj->children.tab[i].dbref = read_long(fp);
+	obj->children.tab[i].next = read_long(fp);
+	obj->children.tab[i].prev_added = read_long(fp);
+	obj->children.tab[i].next_added = read_long(fp);
+    }
+}
+
 static void unpack_vars(Object *obj, FILE *fp)
 {
     int i;
@@ -329,7 +387,7 @@ static void unpack_vars(Object *obj, FILE *fp)
 	obj->vars.hashtab[i] = read_long(fp);
 	obj->vars.tab[i].name = read_ident(fp);
 	if (obj->vars.tab[i].name != NOT_AN_IDENT) {
-	    obj->vars.tab[i].class = read_ident(fp);
+	    obj->vars.tab[i].class = read_long(fp);
 	    unpack_data(&obj->vars.tab[i].val, fp);
 	}
 	obj->vars.tab[i].next = read_long(fp);
@@ -383,12 +441,18 @@ static Method *unpack_method(FILE *fp)
 	for (i = 0; i < method->num_vars; i++)
 	    method->varnames[i] = read_long(fp);
     }
+    method->max_stack = read_long(fp);
 
     method->num_opcodes = read_long(fp);
-    method->opcodes = TMALLOC(long, method->num_opcodes);
+    method->opcodes = TMALLOC(Opcode, method->num_opcodes);
     for (i = 0; i < method->num_opcodes; i++)
 	method->opcodes[i] = read_long(fp);
 
+    /* Variable and message caches start out empty. */
+    method->num_var_caches = read_long(fp);
+    method->num_message_caches = read_long(fp);
+    method_prepare(method);
+
     method->num_error_lists = read_long(fp);
     if (method->num_error_lists) {
 	method->error_lists = TMALLOC(Error_list, method->num_error_lists);
@@ -440,7 +504,7 @@ int size_object(Object *obj)
     int size = 0;
 
     size = size_list(obj->parents);
-    size += size_list(obj->children);
+    size += size_children(obj);
     size += size_vars(obj);
     size += size_methods(obj);
     size += size_strings(obj);
@@ -527,6 +591,27 @@ static int size_data(Data *data)
     return size;
 }
 
+static int size_children(Object *obj)
+{
+    int size = 0, i;
+
+    size += size_long(obj->children.size);
+    size += size_long(obj->children.blanks);
+    size += size_long(obj->children.first);
+    size += size_long(obj->children.last);
+    size += size_long(obj->children.num);
+
+    for (i = 0; i < obj->children.size; i++) {
+	size += size_long(obj->children.hashtab[i]);
+	size += size_long(obj->children.tab[i].dbref);
+	size += size_long(obj->children.tab[i].next);
+	size += size_long(obj->children.tab[i].prev_added);
+	size += size_long(obj->children.tab[i].next_added);
+    }
+
+    return size;
+}
+
 static int size_vars(Object *obj)
 {
     int size = 0, i;
@@ -538,7 +623,7 @@ static int size_vars(Object *obj)
 	size += size_long(obj->vars.hashtab[i]);
 	if (obj->vars.tab[i].name != NOT_AN_IDENT) {
 	    size += size_ident(obj->vars.tab[i].name);
-	    size += size_ident(obj->vars.tab[i].class);
+	    size += size_long(obj->vars.tab[i].class);
 	    size += size_data(&obj->vars.tab[i].val);
 	} else {
 	    size += size_long(NOT_AN_IDENT);
@@ -582,11 +667,15 @@ static int size_method(Method *method)
     size += size_long(method->num_vars);
     for (i = 0; i < method->num_vars; i++)
 	size += size_long(method->varnames[i]);
+    size += size_long(method->max_stack);
 
     size += size_long(method->num_opcodes);
     for (i = 0; i < method->num_opcodes; i++)
 	size += size_long(method->opcodes[i]);
 
+    size += size_long(method->num_var_caches);
+    size += size_long(method->num_message_caches);
+
     size += size_long(method->num_error_lists);
     for (i = 0; i < method->num_error_lists; i++) {
 	size += size_long(method->error_lists[i].num_errors);
@@ -631,48 +720,33 @@ static int size_idents(Object *obj)
     return size;
 }
 
+/* Identifiers are stored by their number in the database's identifier
+ * dictionary. */
 static void write_ident(long id, FILE *fp)
 {
-    char *s;
-    int len;
-
-    s = ident_name(id);
-    len = strlen(s);
-    write_long(len, fp);
-    fwrite(s, sizeof(char), len, fp);
+    write_long(db_ident_num(id), fp);
 }
 
 static long read_ident(FILE *fp)
 {
-    int len;
-    char *s;
-    long id;
+    long num;
 
-    /* Read the length of the identifier. */
-    len = read_long(fp);
+    num = read_long(fp);
 
-    /* If the length is -1, it's not really an identifier, but a -1 signalling
+    /* If the number is -1, it's not really an identifier, but a -1 signalling
      * a blank variable or method. */
-    if (len == NOT_AN_IDENT)
+    if (num == NOT_AN_IDENT)
 	return NOT_AN_IDENT;
 
-    /* Otherwise, it's an identifier.  Read it into temporary storage. */
-    s = TMALLOC(char, len + 1);
-    fread(s, sizeof(char), len, fp);
-    s[len] = 0;
-
-    /* Get the index for the identifier and free the temporary memory. */
-    id = ident_get(s);
-    tfree_chars(s);
-
-    return id;
+    return ident_dup(db_ident(num));
 }
 
+/* An identifier which isn't in the dictionary yet is counted at the largest
+ * number it could get, since only pack_object() gives it a number.  This
+ * overestimates the object's size by a few bytes at most. */
 static long size_ident(long id)
 {
-    int len = strlen(ident_name(id));
-
-    return size_long(len) + (len * sizeof(char));
+    return size_long(db_ident_num_bound(id));
 }
 
 /* Write a four-byte number to fp in a consistent byte-order. */
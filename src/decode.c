@@ -59,13 +59,16 @@ static String *unparse_expr_prec(String *str, Expr *expr, int caller_type,
 				 int assoc);
 static int prec_level(int opcode);
 static char *binary_token(int opcode);
+static int integer_op_base(int opcode);
+static long big_integer(int pos);
 static List *add_and_discard_string(List *output, String *str);
 static char *varname(int ind);
+static Opcode *general_opcodes(Method *method);
 
 /* These globals get set at the start and are never modified. */
 static Object *the_object;
 static Method *the_method;
-static long *the_opcodes;
+static Opcode *the_opcodes;
 static int the_increment;
 static int the_parens_flag;
 
@@ -127,8 +130,10 @@ int line_number(Method *method, int pc)
     if (count > 1)
 	count++;
 
-    the_opcodes = method->opcodes;
-    return count + count_lines(0, pc, &flags);
+    the_opcodes = general_opcodes(method);
+    count += count_lines(0, pc, &flags);
+    pfree(compiler_pile);
+    return count;
 }
 
 static int count_lines(int start, int end, unsigned *flags)
@@ -249,6 +254,8 @@ static int count_lines(int start, int end, unsigned *flags)
 	  case FOR_RANGE:
 	  case FOR_LIST:
 	  case WHILE:
+	  case FORK:
+	  case ATOMIC:
 	  case LAST_CASE_VALUE:
 	  case LAST_CASE_RANGE: {
 	      int opcode = the_opcodes[start], body_end;
@@ -388,7 +395,7 @@ List *decompile(Method *method, Object *object, int increment, int parens)
     /* Set globals so we don't have to pass method and object around. */
     the_object = object;
     the_method = method;
-    the_opcodes = method->opcodes;
+    the_opcodes = general_opcodes(method);
     the_increment = increment;
     the_parens_flag = parens;
 
@@ -488,7 +495,7 @@ static Stmt *decompile_stmt(int *pos_ptr)
       case SET_OBJ_VAR:
 	/* SET_OBJ_VAR opcode follows one expression. */
 	var = ident_name(object_get_ident(the_object, the_opcodes[pos + 1]));
-	(*pos_ptr) = pos + 2;
+	(*pos_ptr) = pos + 3;
 	return assign_stmt(var, exprs->expr);
 
       case IF:
@@ -543,6 +550,22 @@ static Stmt *decompile_stmt(int *pos_ptr)
 	(*pos_ptr) = end;
 	return while_stmt(exprs->expr, body);
 
+      case FORK:
+	/* FORK statement follows one expression.  The end is after the
+	 * FORK_END opcode. */
+	end = the_opcodes[pos + 1];
+	body = decompile_body(pos + 2, end - 1);
+	(*pos_ptr) = end;
+	return fork_stmt(exprs->expr, body);
+
+      case ATOMIC:
+	/* ATOMIC statement follows no expressions.  The end is after the
+	 * ATOMIC_END opcode. */
+	end = the_opcodes[pos + 1];
+	body = decompile_body(pos + 2, end - 1);
+	(*pos_ptr) = end;
+	return atomic_stmt(body);
+
       case SWITCH: {
 	  Case_list *cases;
 
@@ -758,6 +781,11 @@ static Expr_list *decompile_expressions_bounded(int *pos_ptr, int expr_end)
 	    pos += 2;
 	    break;
 
+	  case BIG_INTEGER:
+	    stack = expr_list(integer_expr(big_integer(pos)), stack);
+	    pos += 3;
+	    break;
+
 	  case STRING:
 	    s = string_chars(the_object->strings[the_opcodes[pos + 1]].str);
 	    stack = expr_list(string_expr(s), stack);
@@ -795,7 +823,15 @@ static Expr_list *decompile_expressions_bounded(int *pos_ptr, int expr_end)
 	  case GET_OBJ_VAR:
 	    s = ident_name(object_get_ident(the_object, the_opcodes[pos + 1]));
 	    stack = expr_list(var_expr(s), stack);
-	    pos += 2;
+	    pos += 3;
+	    break;
+
+	  case GET_LOCAL_LOCAL:
+	    s = varname(the_opcodes[pos + 1]);
+	    stack = expr_list(var_expr(s), stack);
+	    s = varname(the_opcodes[pos + 2]);
+	    stack = expr_list(var_expr(s), stack);
+	    pos += 3;
 	    break;
 
 	  case START_ARGS: {
@@ -806,22 +842,25 @@ static Expr_list *decompile_expressions_bounded(int *pos_ptr, int expr_end)
 	      switch(the_opcodes[pos]) {
 
 		case PASS:
+		case TAIL_PASS:
 		  stack = expr_list(pass_expr(args), stack);
 		  pos++;
 		  break;
 
 		case MESSAGE:
+		case TAIL_MESSAGE:
 		  s = ident_name(object_get_ident(the_object,
 						  the_opcodes[pos + 1]));
 		  stack->expr = message_expr(stack->expr, s, args);
-		  pos += 2;
+		  pos += 3;
 		  break;
 
 		case EXPR_MESSAGE:
+		case TAIL_EXPR_MESSAGE:
 		  stack->next->expr = expr_message_expr(stack->next->expr,
 							stack->expr, args);
 		  stack = stack->next;
-		  pos++;
+		  pos += 2;
 		  break;
 
 		case LIST:
@@ -948,6 +987,18 @@ static Expr_list *decompile_expressions_bounded(int *pos_ptr, int expr_end)
 	    pos++;
 	    break;
 
+	  case ADD_INTEGER:
+	  case SUBTRACT_INTEGER:
+	  case MULTIPLY_INTEGER:
+	  case DIVIDE_INTEGER:
+	  case LESS_INTEGER:
+	    /* The right side is the constant in the argument. */
+	    stack->expr = binary_expr(integer_op_base(the_opcodes[pos]),
+				      stack->expr,
+				      integer_expr(the_opcodes[pos + 1]));
+	    pos += 2;
+	    break;
+
 	  case SPLICE_ADD: {
 	      Expr_list **elistp = &stack->expr->u.args;
 
@@ -1154,6 +1205,18 @@ static List *unparse_stmt(List *output, Stmt *stmt, int indent, Stmt *last)
 	str = string_addc(str, ')');
 	return unparse_body(output, stmt->u.while_.body, str, indent);
 
+      case FORK:
+	str = string_of_char(' ', indent);
+	str = string_add_chars(str, "fork (", 6);
+	str = unparse_expr(str, stmt->u.fork.time);
+	str = string_addc(str, ')');
+	return unparse_body(output, stmt->u.fork.body, str, indent);
+
+      case ATOMIC:
+	str = string_of_char(' ', indent);
+	str = string_add_chars(str, "atomic", 6);
+	return unparse_body(output, stmt->u.atomic, str, indent);
+
       case SWITCH:
 	str = string_of_char(' ', indent);
 	str = string_add_chars(str, "switch (", 8);
@@ -1540,6 +1603,33 @@ static char *binary_token(int opcode)
     return "??";
 }
 
+/* Effects: Returns the value of the BIG_INTEGER instruction at pos. */
+static long big_integer(int pos)
+{
+    long high = the_opcodes[pos + 1];
+    unsigned int low = the_opcodes[pos + 2];
+
+    return high * 65536 * 65536 + (long) low;
+}
+
+/* Effects: Returns the operator which the superinstruction opcode stands in
+ *	    for when its right side is an integer constant. */
+static int integer_op_base(int opcode)
+{
+    switch (opcode) {
+      case ADD_INTEGER:
+	return '+';
+      case SUBTRACT_INTEGER:
+	return '-';
+      case MULTIPLY_INTEGER:
+	return '*';
+      case DIVIDE_INTEGER:
+	return '/';
+      default:
+	return '<';
+    }
+}
+
 static List *add_and_discard_string(List *output, String *str)
 {
     Data d;
@@ -1575,3 +1665,23 @@ static char *varname(int ind)
     return ident_name(id);
 }
 
+/* Returns a copy of method's opcodes, allocated from compiler_pile, with the
+ * instructions the interpreter has quickened put back in their general
+ * forms. */
+static Opcode *general_opcodes(Method *method)
+{
+    Opcode *opcodes;
+    Op_info *info;
+    int i, len;
+
+    opcodes = PMALLOC(compiler_pile, Opcode, method->num_opcodes);
+    i = 0;
+    while (i < method->num_opcodes) {
+	info = &op_table[method->opcodes[i]];
+	len = 1 + (info->arg1 != 0) + (info->arg2 != 0);
+	MEMCPY(&opcodes[i], &method->opcodes[i], len);
+	opcodes[i] = info->general;
+	i += len;
+    }
+    return opcodes;
+}
@@ -231,11 +231,33 @@ List *dict_key_value_pair(Dict *dict, int i)
     if (i >= dict->keys->len)
 	return NULL;
     l = list_new(2);
+    l->len = 2;
     data_dup(&l->el[0], &dict->keys->el[i]);
     data_dup(&l->el[1], &dict->values->el[i]);
     return l;
 }
 
+/* Effects: Returns the same thing as dict_key_value_pair(), taking over the
+ *	    caller's reference to pair.  If nothing else refers to pair and it
+ *	    is a pair, its elements are replaced in place, so that a loop over
+ *	    a dictionary doesn't allocate a new pair for every entry. */
+List *dict_reuse_key_value_pair(Dict *dict, int i, List *pair)
+{
+    Data *d;
+
+    if (pair->refs != 1 || list_length(pair) != 2) {
+	list_discard(pair);
+	return dict_key_value_pair(dict, i);
+    }
+    d = list_first(pair);
+    data_discard(d);
+    data_dup(d, &dict->keys->el[i]);
+    d = list_next(pair, d);
+    data_discard(d);
+    data_dup(d, &dict->values->el[i]);
+    return pair;
+}
+
 String *dict_add_literal_to_str(String *str, Dict *dict)
 {
     int i;
@@ -28,6 +28,7 @@ long dict_find(Dict *dict, Data *key, Data *ret);
 int dict_contains(Dict *dict, Data *key);
 List *dict_keys(Dict *dict);
 List *dict_key_value_pair(Dict *mapping, int i);
+List *dict_reuse_key_value_pair(Dict *dict, int i, List *pair);
 int dict_size(Dict *dict);
 String *dict_add_literal_to_str(String *str, Dict *dict);
 
@@ -19,6 +19,7 @@
 #include "db.h"
 #include "ident.h"
 #include "lookup.h"
+#include "io.h"
 
 static Method *text_dump_get_method(FILE *fp, Object *obj, char *name);
 static long get_dbref(char **sptr);
@@ -29,6 +30,12 @@ extern int cur_search;
  * performing it under low-memory conditions. */
 int binary_dump(void)
 {
+    /* A query process can't write the database.  The server can, once the
+     * queries reading it are gone; see make_query() in io.c. */
+    if (db_read_only())
+	return 0;
+    cancel_queries();
+
     cache_sync();
     return 1;
 }
@@ -41,6 +48,11 @@ int text_dump(void)
     Object *obj;
     long name, dbref;
 
+    /* Writing the database out needs it thawed, as for binary_dump(). */
+    if (db_read_only())
+	return 0;
+    cancel_queries();
+
     /* Open the output file. */
     fp = open_scratch_file("textdump.new", "w");
     if (!fp)
@@ -28,7 +28,7 @@ void op_traceback(void)
 	return;
     }
 
-    push_list(cur_frame->handler_info->traceback);
+    push_list(traceback_list(cur_frame->handler_info->traceback));
 }
 
 void op_throw(void)
@@ -55,7 +55,7 @@ void op_throw(void)
 void op_rethrow(void)
 {
     Data *args;
-    List *traceback;
+    Traceback *traceback;
 
     if (!func_init_1(&args, ERROR))
 	return;
@@ -65,8 +65,11 @@ void op_rethrow(void)
 	return;
     }
 
-    /* Abort the current frame and propagate an error in the caller. */
-    traceback = list_dup(cur_frame->handler_info->traceback);
+    /* Abort the current frame and propagate an error in the caller, taking
+     * the traceback away from the handler so that it carries on from
+     * here. */
+    traceback = cur_frame->handler_info->traceback;
+    cur_frame->handler_info->traceback = NULL;
     frame_return();
     propagate_error(traceback, args[0].u.error);
 }
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <time.h>
 #include "x.tab.h"
 #include "execute.h"
 #include "memory.h"
@@ -15,26 +16,66 @@
 #include "cache.h"
 #include "util.h"
 #include "opcodes.h"
+#include "operator.h"
 #include "cmstring.h"
 #include "log.h"
 #include "decode.h"
+#include "timer.h"
 
 #define STACK_STARTING_SIZE		(256 - STACK_MALLOC_DELTA)
 #define ARG_STACK_STARTING_SIZE		(32 - ARG_STACK_MALLOC_DELTA)
+#define SITES_MALLOC_DELTA		4
 
 extern int running;
 
+static Task *task_new(Connection *conn);
+static void task_load(Task *task);
+static Task *task_unload(void);
+static void task_send(Dbref dbref, Ident message);
+static void task_file(Task *task);
+static void task_run(Task *task, int can_preempt);
+static Task *task_take(Task **list, long id);
+static void preempt(void);
+static Frame *frame_new(Object *obj, Method *method, Dbref sender,
+			Dbref caller);
 static void execute(void);
 static void out_of_ticks_error(void);
-static void start_error(Ident error, String *explanation, Data *arg,
-			List *location);
-static List *traceback_add(List *traceback, Ident error);
-static void fill_in_method_info(Data *d);
+static void find_jump_counts(Jump_counts *counts, int from, int to);
+static void frame_release(Frame *frame);
+static Traceback *traceback_new(Ident location_type, Ident error,
+				String *explanation, Data *arg);
+static void traceback_add(Traceback *traceback, Ident error);
+static Error_site *traceback_new_site(Traceback *traceback, Ident error);
+static void record_site(Error_site *site, Frame *frame);
+static void copy_site(Error_site *dest, Error_site *src);
+static void site_discard(Error_site *site);
+static void fill_in_site_info(Data *d, Error_site *site);
 
 static Frame *frame_store = NULL;
 static int frame_depth;
+static int elided_count;
 String *numargs_str;
 
+/* The running task, tasks waiting for a time slice in the order they will get
+ * one, tasks waiting for resume(), the number of forked tasks waiting in the
+ * timer wheel for their start time, and finished tasks kept for their stacks.
+ * The running task's state lives in the globals below while it runs. */
+static Task *cur_task;
+static Task *run_queue, *run_queue_tail;
+static int run_queue_len;
+static Task *suspended;
+static int num_delayed;
+static Task *task_store;
+static long next_task_id;
+
+/* Ticks left in the running task's time slice, and whether it can be
+ * preempted when they run out. */
+static int slice_ticks;
+static int preemptible;
+
+/* Where the value returned by a query's task goes; see task_query(). */
+static Data *query_result;
+
 Frame *cur_frame, *suspend_frame;
 Connection *cur_conn;
 Data *stack;
@@ -44,16 +85,13 @@ long task_id;
 
 void init_execute()
 {
-    stack = EMALLOC(Data, STACK_STARTING_SIZE);
-    stack_size = STACK_STARTING_SIZE;
-    stack_pos = 0;
-
-    arg_starts = EMALLOC(int, ARG_STACK_STARTING_SIZE);
-    arg_size = ARG_STACK_STARTING_SIZE;
-    arg_pos = 0;
+    /* Start with one task's stacks in the store. */
+    task_file(task_new(NULL));
+    init_timers();
 }
 
-/* Execute a task by sending a message to an object. */
+/* Execute a task by sending a message to an object.  The task runs for one
+ * time slice now, and for more from run_tasks() if it needs them. */
 void task(Connection *conn, Dbref dbref, long message, int num_args, ...)
 {
     va_list arg;
@@ -65,8 +103,7 @@ void task(Connection *conn, Dbref dbref, long message, int num_args, ...)
     }
 
     /* Set global variables. */
-    cur_conn = conn;
-    frame_depth = 0;
+    task_load(task_new(conn));
 
     va_start(arg, num_args);
     check_stack(num_args);
@@ -74,27 +111,488 @@ void task(Connection *conn, Dbref dbref, long message, int num_args, ...)
 	data_dup(&stack[stack_pos++], va_arg(arg, Data *));
     va_end(arg);
 
+    task_send(dbref, message);
+}
+
+/* Modifies:	The running task, which task_send() files.
+ * Requires:	The running task's stack holds only the arguments.
+ * Effects:	Sends message to dbref with the arguments, and runs the task
+ *		for one time slice if the object has a method for it. */
+static void task_send(Dbref dbref, Ident message)
+{
+    preemptible = 1;
+
     /* Send the message.  If this is succesful, start the task by calling
      * execute(). */
-    if (send_message(dbref, message, 0, 0) == NOT_AN_IDENT) {
+    if (send_message(dbref, message, 0, 0, NULL) == NOT_AN_IDENT)
 	execute();
-	if (stack_pos != 0)
-	    panic("Stack not empty after interpretation.");
-	task_id++;
-    } else {
+    else
 	pop(stack_pos);
-    }
+    task_file(task_unload());
 }
 
-/* Execute a task by evaluating a method on an object. */
+/* Execute a task by evaluating a method on an object.  The text dump reader
+ * uses this, and each eval should finish before the next one starts, so the
+ * task is not preempted, and tasks it resumes run before we return. */
 void task_method(Connection *conn, Object *obj, Method *method)
 {
-    cur_conn = conn;
+    task_load(task_new(conn));
+    preemptible = 0;
     frame_start(obj, method, NOT_AN_IDENT, NOT_AN_IDENT, 0, 0);
     execute();
+    task_file(task_unload());
+
+    while (run_queue && running)
+	task_run(run_queue, 0);
+}
+
+/* Modifies:	The interpreter globals, *result.
+ * Requires:	We are in a query process; see make_query() in io.c.
+ * Effects:	Sends message to dbref with the arguments in args, in a new
+ *		task which isn't preempted, and sets *result to the value the
+ *		task returns, or to an error if the message fails.  Other
+ *		tasks don't run. */
+void task_query(Dbref dbref, Ident message, List *args, Data *result)
+{
+    Data *d;
+    Ident error;
+
+    task_load(task_new(NULL));
+    preemptible = 0;
+    check_stack(list_length(args));
+    for (d = list_first(args); d; d = list_next(args, d))
+	data_dup(&stack[stack_pos++], d);
+
+    result->type = -1;
+    query_result = result;
+    error = send_message(dbref, message, 0, 0, NULL);
+    if (error == NOT_AN_IDENT)
+	execute();
+    else
+	pop(stack_pos);
+    query_result = NULL;
+    task_file(task_unload());
+
+    if (result->type == -1) {
+	result->type = ERROR;
+	result->u.error = ident_dup((error == NOT_AN_IDENT) ? methoderr_id
+				    : error);
+    }
+}
+
+/* Modifies:	val.
+ * Effects:	Called with the value a task's first frame returns.  Keeps it
+ *		if the task is a query's, or discards it otherwise. */
+void task_return(Data *val)
+{
+    if (query_result) {
+	*query_result = *val;
+	query_result = NULL;
+    } else {
+	data_discard(val);
+    }
+}
+
+/* Modifies:	The run queue, and the tasks on it.
+ * Effects:	Gives each task waiting on the run queue one time slice, in
+ *		order.  A task which is preempted goes back on the end of the
+ *		queue, and waits for the next call. */
+void run_tasks(void)
+{
+    int n;
+
+    for (n = run_queue_len; n > 0 && run_queue && running; n--)
+	task_run(run_queue, 1);
+}
+
+/* Effects:	Returns nonzero if there are tasks waiting for a time slice. */
+int tasks_runnable(void)
+{
+    return run_queue != NULL;
+}
+
+/* Effects:	Returns nonzero if there are tasks which have not finished,
+ *		besides the running task. */
+int tasks_pending(void)
+{
+    return run_queue || suspended || num_delayed;
+}
+
+/* Effects:	Returns the number of seconds until wake_tasks() should next be
+ *		called, or -1 if there are no forked or scheduled tasks. */
+int tasks_next_wake(void)
+{
+    return timer_wait(time(NULL));
+}
+
+/* Modifies:	The timer wheel, the run queue.
+ * Effects:	Moves forked tasks whose start time has come to the end of the
+ *		run queue, and sends the messages whose time has come, each in
+ *		a new task. */
+void wake_tasks(void)
+{
+    Timer *timer;
+    Task *task;
+    Data *d;
+    time_t t;
+
+    time(&t);
+    while (running && (timer = timer_expire(t)) != NULL) {
+	if (timer->task) {
+	    num_delayed--;
+	    task_file(timer->task);
+	    timer_discard(timer);
+	    continue;
+	}
 
-    if (stack_pos != 0)
-	panic("Stack not empty after interpretation.");
+	/* The task gets the ID schedule() returned. */
+	task = task_new(NULL);
+	task->id = timer->id;
+	task_load(task);
+	check_stack(list_length(timer->args));
+	for (d = list_first(timer->args); d; d = list_next(timer->args, d))
+	    data_dup(&stack[stack_pos++], d);
+	task_send(timer->dbref, timer->message);
+	timer_discard(timer);
+    }
+}
+
+/* Effects:	Arranges to send message to the object dbref with the
+ *		arguments in args, in a new task, after delay seconds.  Returns
+ *		the ID the task will have. */
+long task_schedule(long delay, Dbref dbref, Ident message, List *args)
+{
+    Timer *timer;
+
+    timer = timer_add(next_task_id++, time(NULL) + delay);
+    timer->dbref = dbref;
+    timer->message = ident_dup(message);
+    timer->args = list_dup(args);
+    return timer->id;
+}
+
+/* Modifies:	The timer wheel or the run queue.
+ * Requires:	pc is the start of the body of a fork statement in the
+ *		current method.
+ * Effects:	Starts a new task which runs the current method from pc, with
+ *		copies of the current frame's arguments and local variables,
+ *		after delay seconds.  The new task ends at the end of the
+ *		body.  Returns the new task's ID. */
+long task_fork(int pc, long delay)
+{
+    Task *task;
+    Timer *timer;
+    Frame *frame;
+    Method *method = cur_frame->method;
+    int i, num_vars, size;
+
+    task = task_new(cur_conn);
+
+    /* Copy the arguments, the rest list and the local variables to the
+     * bottom of the new task's stack, with room above them for everything
+     * the method will push. */
+    num_vars = method->num_args + (method->rest != -1) + method->num_vars;
+    size = num_vars + method->max_stack;
+    if (task->stack_size < size) {
+	task->stack = EREALLOC(task->stack, Data, size);
+	task->stack_size = size;
+    }
+    for (i = 0; i < num_vars; i++)
+	data_dup(&task->stack[i], &stack[cur_frame->var_start + i]);
+    task->stack_pos = num_vars;
+
+    frame = frame_new(cur_frame->object, method, cur_frame->sender,
+		      cur_frame->caller);
+    frame->pc = pc;
+    frame->ticks += method_count(method, pc);
+    frame->stack_start = 0;
+    frame->var_start = 0;
+    frame->caller_frame = NULL;
+    task->frame = frame;
+    task->frame_depth = 1;
+    task->elided_count = 0;
+
+    if (delay == 0) {
+	task_file(task);
+    } else {
+	timer = timer_add(task->id, time(NULL) + delay);
+	timer->task = task;
+	num_delayed++;
+    }
+
+    return task->id;
+}
+
+/* Modifies:	cur_task, cur_frame.
+ * Requires:	The caller is an operator which has pushed its result, and
+ *		does nothing more with cur_frame.
+ * Effects:	Suspends the running task until resume() names it. */
+void task_suspend(void)
+{
+    cur_task->suspended = 1;
+    cur_task->frame = cur_frame;
+    cur_frame = NULL;
+}
+
+/* Modifies:	The suspended task with the ID id, if there is one.
+ * Effects:	Puts the task on the run queue, with value as the result of
+ *		the suspend() call it stopped in, or 0 if value is NULL.
+ *		Returns 0 if there is no such task, or 1 if there is. */
+int task_resume(long id, Data *value)
+{
+    Task *task;
+    Data *result;
+
+    task = task_take(&suspended, id);
+    if (!task)
+	return 0;
+
+    if (value) {
+	result = &task->stack[task->stack_pos - 1];
+	data_discard(result);
+	data_dup(result, value);
+    }
+    task->suspended = 0;
+    task_file(task);
+    return 1;
+}
+
+/* Modifies:	The suspended, waiting, forked or scheduled task with the ID
+ *		id, if there is one.
+ * Effects:	Ends the task without running any more of it.  Returns 0 if
+ *		there is no such task, or 1 if there is. */
+int task_cancel(long id)
+{
+    Task *task, *self;
+    Timer *timer;
+    Frame *frame;
+
+    task = task_take(&suspended, id);
+    if (!task && (timer = timer_take(id)) != NULL) {
+	/* A scheduled message has no task yet. */
+	task = timer->task;
+	timer_discard(timer);
+	if (!task)
+	    return 1;
+	num_delayed--;
+    }
+    if (!task) {
+	task = task_take(&run_queue, id);
+	if (!task)
+	    return 0;
+	run_queue_len--;
+	if (task->conn)
+	    task->conn->waiting_tasks--;
+	if (task == run_queue_tail) {
+	    run_queue_tail = run_queue;
+	    while (run_queue_tail && run_queue_tail->next)
+		run_queue_tail = run_queue_tail->next;
+	}
+    }
+
+    /* Set the running task aside while we unwind the cancelled one. */
+    frame = cur_frame;
+    self = task_unload();
+    task_load(task);
+    while (cur_frame)
+	frame_return();
+    task->suspended = 0;
+    task_file(task_unload());
+    task_load(self);
+    cur_frame = frame;
+    return 1;
+}
+
+/* Modifies:	Connections of tasks.
+ * Effects:	Called when conn is about to be freed.  Tasks which have not
+ *		finished no longer have a connection. */
+void task_forget_connection(Connection *conn)
+{
+    Task *task;
+    Timer *timer;
+
+    for (task = run_queue; task; task = task->next) {
+	if (task->conn == conn)
+	    task->conn = NULL;
+    }
+    for (task = suspended; task; task = task->next) {
+	if (task->conn == conn)
+	    task->conn = NULL;
+    }
+    for (timer = timer_next(NULL); timer; timer = timer_next(timer)) {
+	if (timer->task && timer->task->conn == conn)
+	    timer->task->conn = NULL;
+    }
+    if (cur_task && cur_conn == conn)
+	cur_conn = NULL;
+}
+
+/* Effects:	Returns a new task for a connection, with empty stacks and no
+ *		frames. */
+static Task *task_new(Connection *conn)
+{
+    Task *task;
+
+    if (task_store) {
+	task = task_store;
+	task_store = task_store->next;
+    } else {
+	task = EMALLOC(Task, 1);
+	task->stack = EMALLOC(Data, STACK_STARTING_SIZE);
+	task->stack_size = STACK_STARTING_SIZE;
+	task->arg_starts = EMALLOC(int, ARG_STACK_STARTING_SIZE);
+	task->arg_size = ARG_STACK_STARTING_SIZE;
+    }
+
+    task->id = next_task_id++;
+    task->conn = conn;
+    task->frame = NULL;
+    task->frame_depth = 0;
+    task->elided_count = 0;
+    task->stack_pos = 0;
+    task->arg_pos = 0;
+    task->suspended = 0;
+    task->next = NULL;
+    return task;
+}
+
+/* Modifies:	The interpreter globals.
+ * Effects:	Makes task the running task, with a fresh time slice. */
+static void task_load(Task *task)
+{
+    cur_task = task;
+    task_id = task->id;
+    cur_conn = task->conn;
+    cur_frame = task->frame;
+    task->frame = NULL;
+    frame_depth = task->frame_depth;
+    elided_count = task->elided_count;
+    stack = task->stack;
+    stack_pos = task->stack_pos;
+    stack_size = task->stack_size;
+    arg_starts = task->arg_starts;
+    arg_pos = task->arg_pos;
+    arg_size = task->arg_size;
+    slice_ticks = TASK_SLICE;
+}
+
+/* Modifies:	cur_task.
+ * Effects:	Stores the interpreter globals back into the running task, and
+ *		returns it.  The task's frame is whatever preempt() or
+ *		task_suspend() left there, or NULL if it finished. */
+static Task *task_unload(void)
+{
+    Task *task = cur_task;
+
+    task->conn = cur_conn;
+    task->frame_depth = frame_depth;
+    task->elided_count = elided_count;
+    task->stack = stack;
+    task->stack_pos = stack_pos;
+    task->stack_size = stack_size;
+    task->arg_starts = arg_starts;
+    task->arg_pos = arg_pos;
+    task->arg_size = arg_size;
+    cur_task = NULL;
+    return task;
+}
+
+/* Modifies:	The task lists.
+ * Effects:	Puts task in the store if it has finished, on the suspended
+ *		list if it is waiting for resume(), or at the end of the run
+ *		queue.  Its connection reads no input while it is on the run
+ *		queue; see io_event_wait(). */
+static void task_file(Task *task)
+{
+    if (!task->frame) {
+	if (task->stack_pos != 0)
+	    panic("Stack not empty after interpretation.");
+	task->next = task_store;
+	task_store = task;
+    } else if (task->suspended) {
+	task->next = suspended;
+	suspended = task;
+    } else {
+	task->next = NULL;
+	if (run_queue_tail)
+	    run_queue_tail->next = task;
+	else
+	    run_queue = task;
+	run_queue_tail = task;
+	run_queue_len++;
+	if (task->conn)
+	    task->conn->waiting_tasks++;
+    }
+}
+
+/* Modifies:	The run queue, task.
+ * Requires:	task is at the head of the run queue.
+ * Effects:	Runs task until it finishes, is preempted (if can_preempt is
+ *		true), or suspends itself. */
+static void task_run(Task *task, int can_preempt)
+{
+    run_queue = task->next;
+    if (!run_queue)
+	run_queue_tail = NULL;
+    run_queue_len--;
+    if (task->conn)
+	task->conn->waiting_tasks--;
+
+    task_load(task);
+    preemptible = can_preempt;
+    execute();
+    task_file(task_unload());
+}
+
+/* Modifies:	*list.
+ * Effects:	Removes the task with the ID id from *list and returns it, or
+ *		returns NULL if it isn't there. */
+static Task *task_take(Task **list, long id)
+{
+    Task *task;
+
+    for (; *list; list = &(*list)->next) {
+	if ((*list)->id == id) {
+	    task = *list;
+	    *list = task->next;
+	    return task;
+	}
+    }
+    return NULL;
+}
+
+/* Modifies:	cur_task, cur_frame.
+ * Requires:	The caller does nothing more with cur_frame before returning
+ *		to execute().
+ * Effects:	Called when the running task has used up its time slice.  If
+ *		the task can be preempted, parks its frames in it and clears
+ *		cur_frame, so that execute() returns and the task goes back on
+ *		the run queue.  Otherwise starts a new slice.  A task inside
+ *		an atomic statement can't be preempted, so that no other task
+ *		sees the objects it changes part way through. */
+static void preempt(void)
+{
+    slice_ticks = TASK_SLICE;
+    if (!preemptible || task_atomic())
+	return;
+    cur_task->frame = cur_frame;
+    cur_frame = NULL;
+}
+
+/* Effects:	Returns 1 if any frame of the running task is inside an atomic
+ *		statement, or 0 if none is. */
+int task_atomic(void)
+{
+    Frame *frame;
+    Error_action_specifier *spec;
+
+    for (frame = cur_frame; frame; frame = frame->caller_frame) {
+	for (spec = frame->specifiers; spec; spec = spec->next) {
+	    if (spec->type == ATOMIC)
+		return 1;
+	}
+    }
+    return 0;
 }
 
 long frame_start(Object *obj, Method *method, Dbref sender, Dbref caller,
@@ -135,16 +633,55 @@ long frame_start(Object *obj, Method *method, Dbref sender, Dbref caller,
 	MEMCPY(d, &stack[stack_pos - num_rest_args], num_rest_args);
 	stack_pos -= num_rest_args;
 
-	/* Push the list onto the stack. */
+	/* Push the list onto the stack.  With no remaining arguments, this
+	 * can go past what the caller reserved, so check for room. */
+	check_stack(1);
 	push_list(rest);
 	list_discard(rest);
     }
 
+    frame = frame_new(obj, method, sender, caller);
+
+    /* Set up stack indices. */
+    frame->stack_start = stack_start;
+    frame->var_start = arg_start;
+
+    /* Reserve room for the local variables and everything the method will
+     * push, and initialize local variables to 0. */
+    check_stack(method->num_vars + method->max_stack);
+    for (i = 0; i < method->num_vars; i++) {
+	stack[stack_pos + i].type = INTEGER;
+	stack[stack_pos + i].u.val = 0;
+    }
+    stack_pos += method->num_vars;
+
+    frame->caller_frame = cur_frame;
+    cur_frame = frame;
+
+    /* A call costs a tick of the task's time slice, so that recursion can't
+     * keep other tasks waiting.  The callers of frame_start() do nothing
+     * more with cur_frame once it succeeds, so we can preempt here. */
+    if (--slice_ticks <= 0)
+	preempt();
+
+    return NOT_AN_IDENT;
+}
+
+/* Effects:	Returns a frame for method on obj, at the start of the method
+ *		with a full allowance of ticks.  The caller sets up its stack
+ *		indices and caller frame. */
+static Frame *frame_new(Object *obj, Method *method, Dbref sender,
+			Dbref caller)
+{
+    Frame *frame;
+
     if (frame_store) {
 	frame = frame_store;
 	frame_store = frame_store->caller_frame;
     } else {
 	frame = EMALLOC(Frame, 1);
+	frame->elided = NULL;
+	frame->elided_size = 0;
     }
 
     frame->object = cache_grab(obj);
@@ -155,26 +692,13 @@ long frame_start(Object *obj, Method *method, Dbref sender, Dbref caller,
     frame->opcodes = method->opcodes;
     frame->pc = 0;
     frame->ticks = METHOD_TICKS;
+    frame->jump.from = frame->loop.from = -1;
 
     frame->specifiers = NULL;
     frame->handler_info = NULL;
+    frame->num_elided = 0;
 
-    /* Set up stack indices. */
-    frame->stack_start = stack_start;
-    frame->var_start = arg_start;
-
-    /* Initialize local variables to 0. */
-    check_stack(method->num_vars);
-    for (i = 0; i < method->num_vars; i++) {
-	stack[stack_pos + i].type = INTEGER;
-	stack[stack_pos + i].u.val = 0;
-    }
-    stack_pos += method->num_vars;
-
-    frame->caller_frame = cur_frame;
-    cur_frame = frame;
-
-    return NOT_AN_IDENT;
+    return frame;
 }
 
 void frame_return(void)
@@ -187,43 +711,405 @@ void frame_return(void)
 	data_discard(&stack[i]);
     stack_pos = cur_frame->stack_start;
 
-    /* Let go of method and objects. */
-    method_discard(cur_frame->method);
-    cache_discard(cur_frame->object);
-    cache_discard(cur_frame->method->object);
+    /* Return to the caller frame. */
+    frame_release(cur_frame);
+    cur_frame = caller_frame;
+}
+
+/* Modifies:	cur_frame, the caller of cur_frame, the stack.
+ * Requires:	cur_frame was just started by a message or pass() whose result
+ *		its caller returns.
+ * Effects:	Takes the caller out of the call stack, moving the new frame's
+ *		part of the stack down over the caller's, so that a chain of
+ *		such calls uses no more frames or stack than one call.  The
+ *		caller is recorded in the new frame so that errors still pass
+ *		through it; see frame_return_error().  Does nothing if the
+ *		caller has error action specifiers, since they must see the new
+ *		frame's errors, or if the task has already replaced
+ *		MAX_TAIL_CALLS frames. */
+void frame_tail_call(void)
+{
+    Frame *frame = cur_frame, *caller = frame->caller_frame;
+    Error_site *sites;
+    int i, shift, size;
+
+    if (caller->specifiers || elided_count >= MAX_TAIL_CALLS)
+	return;
+
+    /* Take over the sites the caller replaced, giving it our empty array in
+     * exchange, and add the caller itself. */
+    sites = frame->elided;
+    size = frame->elided_size;
+    frame->elided = caller->elided;
+    frame->elided_size = caller->elided_size;
+    frame->num_elided = caller->num_elided;
+    caller->elided = sites;
+    caller->elided_size = size;
+    caller->num_elided = 0;
+    if (frame->num_elided == frame->elided_size) {
+	frame->elided_size = frame->elided_size * 2 + SITES_MALLOC_DELTA;
+	frame->elided = EREALLOC(frame->elided, Error_site,
+				 frame->elided_size);
+    }
+    record_site(&frame->elided[frame->num_elided++], caller);
+    elided_count++;
+
+    /* Discard the caller's part of the stack and move ours down. */
+    shift = frame->stack_start - caller->stack_start;
+    for (i = caller->stack_start; i < frame->stack_start; i++)
+	data_discard(&stack[i]);
+    MEMMOVE(&stack[caller->stack_start], &stack[frame->stack_start],
+	    stack_pos - frame->stack_start);
+    stack_pos -= shift;
+    frame->stack_start -= shift;
+    frame->var_start -= shift;
+
+    frame->caller_frame = caller->caller_frame;
+    frame_release(caller);
+}
+
+/* Modifies:	cur_frame, traceback.
+ * Effects:	Returns from the current frame because of an error, adding a
+ *		site to traceback for each frame the current frame replaced in
+ *		tail calls, as though they were still on the call stack.  None
+ *		of them had a handler, so the first gets error and the rest get
+ *		~methoderr.  Returns the error for the caller. */
+Ident frame_return_error(Traceback *traceback, Ident error)
+{
+    Error_site *site, *elided;
+    int i;
+
+    for (i = cur_frame->num_elided - 1; i >= 0; i--) {
+	elided = &cur_frame->elided[i];
+	site = traceback_new_site(traceback, error);
+	copy_site(site, elided);
+	error = methoderr_id;
+    }
+
+    frame_return();
+    return error;
+}
+
+/* Modifies:	frame, frame_store.
+ * Effects:	Lets go of everything frame holds besides its part of the stack,
+ *		and puts it in the frame store for reuse. */
+static void frame_release(Frame *frame)
+{
+    Error_action_specifier *spec;
+    Handler_info *hinfo;
+    Object *definer = frame->method->object;
+    int i;
+
+    /* Let go of method and objects.  The definer goes last, since freeing it
+     * frees its methods. */
+    cache_discard(frame->object);
+    method_discard(frame->method);
+    cache_discard(definer);
 
     /* Discard any error action specifiers. */
-    while (cur_frame->specifiers)
-	pop_error_action_specifier();
+    while (frame->specifiers) {
+	spec = frame->specifiers;
+	frame->specifiers = spec->next;
+	free(spec);
+    }
 
     /* Discard any handler information. */
-    while (cur_frame->handler_info)
-	pop_handler_info();
+    while (frame->handler_info) {
+	hinfo = frame->handler_info;
+	if (hinfo->traceback)
+	    traceback_discard(hinfo->traceback);
+	ident_discard(hinfo->error);
+	frame->handler_info = hinfo->next;
+	free(hinfo);
+    }
 
-    /* Append frame to frame store for later reuse. */
-    cur_frame->caller_frame = frame_store;
-    frame_store = cur_frame;
+    /* Discard the frames this one replaced. */
+    for (i = 0; i < frame->num_elided; i++)
+	site_discard(&frame->elided[i]);
+    elided_count -= frame->num_elided;
+    frame->num_elided = 0;
 
-    /* Return to the caller frame. */
-    cur_frame = caller_frame;
+    /* Append frame to frame store for later reuse. */
+    frame->caller_frame = frame_store;
+    frame_store = frame;
 
     frame_depth--;
 }
 
+/* Ticks are not charged here, but when control jumps; see frame_jump(). */
+#if defined(THREADED_DISPATCH) && defined(__GNUC__)
+
+/* Fetch the next instruction and jump to its label.  Operators may change
+ * cur_frame, so reload it for each instruction. */
+#define NEXT()								\
+    if ((frame = cur_frame) == NULL)					\
+	return;								\
+    frame->last_opcode = frame->opcodes[frame->pc++];			\
+    goto *dispatch[frame->last_opcode]
+
 static void execute(void)
 {
-    int opcode;
+    static void *dispatch[LAST_TOKEN];
+    static struct {
+	int opcode;
+	void *label;
+    } labels[] = {
+	{ COMMENT, &&comment },			{ POP, &&pop },
+	{ SET_LOCAL, &&set_local },		{ SET_OBJ_VAR, &&set_obj_var },
+	{ IF, &&if_ },				{ IF_ELSE, &&if_ },
+	{ ELSE, &&else_ },			{ FOR_RANGE, &&for_range },
+	{ FOR_LIST, &&for_list },		{ WHILE, &&while_ },
+	{ SWITCH, &&switch_ },			{ CASE_VALUE, &&case_value },
+	{ CASE_RANGE, &&case_range },
+	{ LAST_CASE_VALUE, &&last_case_value },
+	{ LAST_CASE_RANGE, &&last_case_range },
+	{ END_CASE, &&end_case },		{ DEFAULT, &&default_ },
+	{ END, &&end },				{ BREAK, &&break_ },
+	{ CONTINUE, &&continue_ },		{ RETURN, &&return_ },
+	{ RETURN_EXPR, &&return_expr },		{ CATCH, &&catch },
+	{ CATCH_END, &&catch_end },		{ HANDLER_END, &&handler_end },
+	{ ATOMIC, &&atomic },			{ ATOMIC_END, &&atomic_end },
+	{ ZERO, &&zero },			{ ONE, &&one },
+	{ INTEGER, &&integer },			{ STRING, &&string },
+	{ DBREF, &&dbref },			{ SYMBOL, &&symbol },
+	{ ERROR, &&error },			{ NAME, &&name },
+	{ GET_LOCAL, &&get_local },		{ GET_OBJ_VAR, &&get_obj_var },
+	{ START_ARGS, &&start_args },		{ PASS, &&pass },
+	{ MESSAGE, &&message },			{ EXPR_MESSAGE, &&expr_message },
+	{ TAIL_PASS, &&tail_pass },		{ TAIL_MESSAGE, &&tail_message },
+	{ TAIL_EXPR_MESSAGE, &&tail_expr_message },
+	{ LIST, &&list },			{ DICT, &&dict },
+	{ INDEX, &&index },			{ AND, &&and },
+	{ OR, &&or },				{ CONDITIONAL, &&if_ },
+	{ SPLICE, &&splice },			{ CRITICAL, &&critical },
+	{ CRITICAL_END, &&critical_end },	{ PROPAGATE, &&propagate },
+	{ PROPAGATE_END, &&propagate_end },
+	{ GET_LOCAL_LOCAL, &&get_local_local },
+	{ FOR_LIST_LIST, &&for_list_list },
+	{ INDEX_LIST_INT, &&index_list_int },
+	{ '!', &&not },				{ NEG, &&negate },
+	{ '*', &&multiply },			{ '/', &&divide },
+	{ '%', &&modulo },			{ '+', &&add },
+	{ '-', &&subtract },			{ EQ, &&equal },
+	{ NE, &&not_equal },			{ '>', &&greater },
+	{ GE, &&greater_or_equal },		{ '<', &&less },
+	{ LE, &&less_or_equal },		{ IN, &&in },
+	{ ADD_INTEGER, &&add_integer },
+	{ SUBTRACT_INTEGER, &&subtract_integer },
+	{ MULTIPLY_INTEGER, &&multiply_integer },
+	{ DIVIDE_INTEGER, &&divide_integer },
+	{ LESS_INTEGER, &&less_integer },	{ ADD_INT_INT, &&add_int_int },
+	{ SUBTRACT_INT_INT, &&subtract_int_int },
+	{ EQUAL_INT_INT, &&equal_int_int },
+	{ NOT_EQUAL_INT_INT, &&not_equal_int_int },
+	{ GREATER_INT_INT, &&greater_int_int },
+	{ GREATER_OR_EQUAL_INT_INT, &&greater_or_equal_int_int },
+	{ LESS_INT_INT, &&less_int_int },
+	{ LESS_OR_EQUAL_INT_INT, &&less_or_equal_int_int }
+    };
+    Frame *frame;
+    int i;
 
-    while (cur_frame) {
-	if (!--(cur_frame->ticks)) {
-	    out_of_ticks_error();
-	} else {
-	    opcode = cur_frame->opcodes[cur_frame->pc];
-	    cur_frame->last_opcode = opcode;
-	    cur_frame->pc++;
-	    (*op_table[opcode].func)();
-	}
+    /* The language operators get labels of their own, so that each has its
+     * own indirect jump to the next instruction.  Everything else, mostly
+     * built-in functions which do enough work that dispatch doesn't matter,
+     * calls through op_table. */
+    if (!dispatch[0]) {
+	for (i = 0; i < LAST_TOKEN; i++)
+	    dispatch[i] = &&call;
+	for (i = 0; i < sizeof(labels) / sizeof(*labels); i++)
+	    dispatch[labels[i].opcode] = labels[i].label;
     }
+
+    NEXT();
+
+  call:				(*op_table[frame->last_opcode].func)();	NEXT();
+  comment:			op_comment();			NEXT();
+  pop:				op_pop();			NEXT();
+  set_local:			op_set_local();			NEXT();
+  set_obj_var:			op_set_obj_var();		NEXT();
+  if_:				op_if();			NEXT();
+  else_:			op_else();			NEXT();
+  for_range:			op_for_range();			NEXT();
+  for_list:			op_for_list();			NEXT();
+  while_:			op_while();			NEXT();
+  switch_:			op_switch();			NEXT();
+  case_value:			op_case_value();		NEXT();
+  case_range:			op_case_range();		NEXT();
+  last_case_value:		op_last_case_value();		NEXT();
+  last_case_range:		op_last_case_range();		NEXT();
+  end_case:			op_end_case();			NEXT();
+  default_:			op_default();			NEXT();
+  end:				op_end();			NEXT();
+  break_:			op_break();			NEXT();
+  continue_:			op_continue();			NEXT();
+  return_:			op_return();			NEXT();
+  return_expr:			op_return_expr();		NEXT();
+  catch:			op_catch();			NEXT();
+  catch_end:			op_catch_end();			NEXT();
+  handler_end:			op_handler_end();		NEXT();
+  atomic:			op_atomic();			NEXT();
+  atomic_end:			op_atomic_end();		NEXT();
+  zero:				op_zero();			NEXT();
+  one:				op_one();			NEXT();
+  integer:			op_integer();			NEXT();
+  string:			op_string();			NEXT();
+  dbref:			op_dbref();			NEXT();
+  symbol:			op_symbol();			NEXT();
+  error:			op_error();			NEXT();
+  name:				op_name();			NEXT();
+  get_local:			op_get_local();			NEXT();
+  get_obj_var:			op_get_obj_var();		NEXT();
+  start_args:			op_start_args();		NEXT();
+  pass:				op_pass();			NEXT();
+  message:			op_message();			NEXT();
+  expr_message:			op_expr_message();		NEXT();
+  tail_pass:			op_tail_pass();			NEXT();
+  tail_message:			op_tail_message();		NEXT();
+  tail_expr_message:		op_tail_expr_message();		NEXT();
+  list:				op_list();			NEXT();
+  dict:				op_dict();			NEXT();
+  index:			op_index();			NEXT();
+  and:				op_and();			NEXT();
+  or:				op_or();			NEXT();
+  splice:			op_splice();			NEXT();
+  critical:			op_critical();			NEXT();
+  critical_end:			op_critical_end();		NEXT();
+  propagate:			op_propagate();			NEXT();
+  propagate_end:		op_propagate_end();		NEXT();
+  get_local_local:		op_get_local_local();		NEXT();
+  for_list_list:		op_for_list_list();		NEXT();
+  index_list_int:		op_index_list_int();		NEXT();
+  not:				op_not();			NEXT();
+  negate:			op_negate();			NEXT();
+  multiply:			op_multiply();			NEXT();
+  divide:			op_divide();			NEXT();
+  modulo:			op_modulo();			NEXT();
+  add:				op_add();			NEXT();
+  subtract:			op_subtract();			NEXT();
+  equal:			op_equal();			NEXT();
+  not_equal:			op_not_equal();			NEXT();
+  greater:			op_greater();			NEXT();
+  greater_or_equal:		op_greater_or_equal();		NEXT();
+  less:				op_less();			NEXT();
+  less_or_equal:		op_less_or_equal();		NEXT();
+  in:				op_in();			NEXT();
+  add_integer:			op_add_integer();		NEXT();
+  subtract_integer:		op_subtract_integer();		NEXT();
+  multiply_integer:		op_multiply_integer();		NEXT();
+  divide_integer:		op_divide_integer();		NEXT();
+  less_integer:			op_less_integer();		NEXT();
+  add_int_int:			op_add_int_int();		NEXT();
+  subtract_int_int:		op_subtract_int_int();		NEXT();
+  equal_int_int:		op_equal_int_int();		NEXT();
+  not_equal_int_int:		op_not_equal_int_int();		NEXT();
+  greater_int_int:		op_greater_int_int();		NEXT();
+  greater_or_equal_int_int:	op_greater_or_equal_int_int();	NEXT();
+  less_int_int:			op_less_int_int();		NEXT();
+  less_or_equal_int_int:	op_less_or_equal_int_int();	NEXT();
+}
+
+#else
+
+static void execute(void)
+{
+    Frame *frame;
+    int pc;
+
+    /* Operators may change cur_frame, so reload it for each instruction. */
+    while ((frame = cur_frame) != NULL) {
+	pc = frame->pc++;
+	frame->last_opcode = frame->opcodes[pc];
+	(*op_table[frame->last_opcode].func)();
+    }
+}
+
+#endif
+
+/* Modifies: cur_frame->pc, cur_frame->ticks.
+ * Effects: Transfers control in the current frame to target.  Rather than
+ *	    paying a tick for each instruction as it runs, a frame pays for
+ *	    a straight run of instructions when control leaves it.
+ *	    method_count() gives the number of instructions before a pc, so
+ *	    the frame's ticks are kept offset by the count at the current pc,
+ *	    and a jump moves the offset from pc to target. */
+void frame_jump(int target)
+{
+    Jump_counts *jump = &cur_frame->jump;
+
+    find_jump_counts(jump, cur_frame->pc, target);
+    cur_frame->ticks += jump->to_count - jump->from_count;
+    cur_frame->pc = target;
+}
+
+/* Modifies: counts.
+ * Effects: Sets counts to the instruction counts at from and to in the
+ *	    current frame's method.  A frame remembers the counts for its last
+ *	    forward jump and its last jump back to the top of a loop, so a
+ *	    loop which takes the same jumps each time around only looks them
+ *	    up once. */
+static void find_jump_counts(Jump_counts *counts, int from, int to)
+{
+    if (counts->from == from && counts->to == to)
+	return;
+    counts->from = from;
+    counts->to = to;
+    counts->from_count = method_count(cur_frame->method, from);
+    counts->to_count = method_count(cur_frame->method, to);
+}
+
+/* Modifies: The current method's opcode at pos.
+ * Effects: Replaces the instruction at pos with opcode, which takes the same
+ *	    arguments.  A general operator calls this when the operands it
+ *	    has just seen have a quickened version of it specialized for
+ *	    them, and the quickened version calls it to put the general
+ *	    operator back if its operands don't match.  The decompiler reads
+ *	    quickened instructions as their general forms (see op_general()
+ *	    in opcodes.c), and the binary database can save either form. */
+void quicken(int pos, int opcode)
+{
+    cur_frame->opcodes[pos] = opcode;
+}
+
+/* Modifies: cur_frame->pc, cur_frame->ticks, maybe cur_frame.
+ * Effects: Jumps back to target at the top of a loop, or aborts the frame
+ *	    with an out of ticks error if it has run out.  Only a loop can run
+ *	    a frame for longer than its method's length, so this is the only
+ *	    place we need to check.  The loop body's ticks also count against
+ *	    the task's time slice, and the task may be preempted; operators
+ *	    call this last, so that is safe. */
+void frame_loop(int target)
+{
+    Jump_counts *loop = &cur_frame->loop;
+
+    find_jump_counts(loop, cur_frame->pc, target);
+    if (cur_frame->ticks <= loop->from_count) {
+	out_of_ticks_error();
+	return;
+    }
+
+    slice_ticks -= loop->from_count - loop->to_count;
+    cur_frame->ticks += loop->to_count - loop->from_count;
+    cur_frame->pc = target;
+    if (slice_ticks <= 0)
+	preempt();
+}
+
+/* Modifies: cur_frame->ticks, slice_ticks.
+ * Effects: Charges the current frame n ticks for work a function is about to
+ *	    do on its behalf and returns 1, or returns 0 without charging
+ *	    anything if the frame has fewer than n ticks left.  The ticks also
+ *	    count against the task's time slice, but we can't preempt in the
+ *	    middle of a function, so the task gets its turn at its next loop or
+ *	    call. */
+int frame_charge(long n)
+{
+    if (n >= cur_frame->ticks - method_count(cur_frame->method,
+					     cur_frame->pc))
+	return 0;
+    cur_frame->ticks -= n;
+    slice_ticks -= n;
+    return 1;
 }
 
 /* Requires cur_frame->pc to be the current instruction.  Do NOT call this
@@ -234,6 +1120,7 @@ void anticipate_assignment(void)
     int opcode, ind;
     long id;
     Data *dp, d;
+    Var_cache *cache;
 
     opcode = cur_frame->opcodes[cur_frame->pc];
     if (opcode == SET_LOCAL) {
@@ -247,10 +1134,12 @@ void anticipate_assignment(void)
 	/* Zero out the object variable, if it exists. */
 	ind = cur_frame->opcodes[cur_frame->pc + 1];
 	id = object_get_ident(cur_frame->method->object, ind);
+	cache = cur_frame->method->var_caches;
+	cache += cur_frame->opcodes[cur_frame->pc + 2];
 	d.type = INTEGER;
 	d.u.val = 0;
 	object_assign_var(cur_frame->object, cur_frame->method->object,
-			  id, &d);
+			  id, &d, cache);
     }
 }
 
@@ -276,7 +1165,10 @@ Ident pass_message(int stack_start, int arg_start)
     return result;
 }
 
-Ident send_message(Dbref dbref, Ident message, int stack_start, int arg_start)
+/* If cache is not NULL, it is the message cache for the calling instruction,
+ * and we use it to find the method. */
+Ident send_message(Dbref dbref, Ident message, int stack_start, int arg_start,
+		   Message_cache *cache)
 {
     Object *obj;
     Method *method;
@@ -289,7 +1181,10 @@ Ident send_message(Dbref dbref, Ident message, int stack_start, int arg_start)
 	return objnf_id;
 
     /* Find the method to run. */
-    method = object_find_method(obj->dbref, message);
+    if (cache)
+	method = object_find_method_cached(obj->dbref, message, cache);
+    else
+	method = object_find_method(obj->dbref, message);
     if (!method) {
 	cache_discard(obj);
 	return methodnf_id;
@@ -321,7 +1216,6 @@ void check_stack(int n)
 
 void push_int(long n)
 {
-    check_stack(1);
     stack[stack_pos].type = INTEGER;
     stack[stack_pos].u.val = n;
     stack_pos++;
@@ -329,7 +1223,6 @@ void push_int(long n)
 
 void push_string(String *str)
 {
-    check_stack(1);
     stack[stack_pos].type = STRING;
     stack[stack_pos].u.str = string_dup(str);
     stack_pos++;
@@ -337,7 +1230,6 @@ void push_string(String *str)
 
 void push_dbref(Dbref dbref)
 {
-    check_stack(1);
     stack[stack_pos].type = DBREF;
     stack[stack_pos].u.dbref = dbref;
     stack_pos++;
@@ -345,7 +1237,6 @@ void push_dbref(Dbref dbref)
 
 void push_list(List *list)
 {
-    check_stack(1);
     stack[stack_pos].type = LIST;
     stack[stack_pos].u.list = list_dup(list);
     stack_pos++;
@@ -353,7 +1244,6 @@ void push_list(List *list)
 
 void push_dict(Dict *dict)
 {
-    check_stack(1);
     stack[stack_pos].type = DICT;
     stack[stack_pos].u.dict = dict_dup(dict);
     stack_pos++;
@@ -361,7 +1251,6 @@ void push_dict(Dict *dict)
 
 void push_symbol(Ident id)
 {
-    check_stack(1);
     stack[stack_pos].type = SYMBOL;
     stack[stack_pos].u.symbol = ident_dup(id);
     stack_pos++;
@@ -369,7 +1258,6 @@ void push_symbol(Ident id)
 
 void push_error(Ident id)
 {
-    check_stack(1);
     stack[stack_pos].type = ERROR;
     stack[stack_pos].u.error = ident_dup(id);
     stack_pos++;
@@ -377,7 +1265,6 @@ void push_error(Ident id)
 
 void push_buffer(Buffer *buf)
 {
-    check_stack(1);
     stack[stack_pos].type = BUFFER;
     stack[stack_pos].u.buffer = buffer_dup(buf);
     stack_pos++;
@@ -498,6 +1385,28 @@ int func_init_2_or_3(Data **args, int *num_args, int type1, int type2,
     return 0;
 }
 
+int func_init_3_or_4(Data **args, int *num_args, int type1, int type2,
+		     int type3, int type4)
+{
+    int arg_start = arg_starts[--arg_pos];
+
+    *args = &stack[arg_start];
+    *num_args = stack_pos - arg_start;
+    if (*num_args < 3 || *num_args > 4)
+	func_num_error(*num_args, "three or four");
+    else if (type1 && stack[arg_start].type != type1)
+	func_type_error("first", &stack[arg_start], english_type(type1));
+    else if (type2 && stack[arg_start + 1].type != type2)
+	func_type_error("second", &stack[arg_start + 1], english_type(type2));
+    else if (type3 && stack[arg_start + 2].type != type3)
+	func_type_error("third", &stack[arg_start + 2], english_type(type3));
+    else if (type4 && *num_args == 4 && stack[arg_start + 3].type != type4)
+	func_type_error("fourth", &stack[arg_start + 3], english_type(type4));
+    else
+	return 1;
+    return 0;
+}
+
 int func_init_1_to_3(Data **args, int *num_args, int type1, int type2,
 		     int type3)
 {
@@ -534,9 +1443,19 @@ void func_type_error(char *which, Data *wrong, char *required)
 
 void throw(Ident error, char *fmt, ...)
 {
+    static String *no_explanation;
     String *str;
     va_list arg;
 
+    /* A critical expression throws away the explanation along with the rest
+     * of the traceback, so don't format one if that's where we're going. */
+    if (cur_frame->specifiers && cur_frame->specifiers->type == CRITICAL) {
+	if (!no_explanation)
+	    no_explanation = string_from_chars("", 0);
+	interp_error(error, no_explanation);
+	return;
+    }
+
     va_start(arg, fmt);
     str = vformat(fmt, arg);
     va_end(arg);
@@ -546,256 +1465,338 @@ void throw(Ident error, char *fmt, ...)
 
 void interp_error(Ident error, String *explanation)
 {
-    List *location;
+    Traceback *traceback;
     Ident location_type;
-    Data *d;
     char *opname;
 
     /* Get the opcode name and decide whether it's a function or not. */
     opname = op_table[cur_frame->last_opcode].name;
     location_type = (islower(*opname)) ? function_id : opcode_id;
 
-    /* Construct a two-element list giving the location. */
-    location = list_new(2);
-    d = list_empty_spaces(location, 2);
-
-    /* The first element is 'function or 'opcode. */
-    d->type = SYMBOL;
-    d->u.symbol = ident_dup(location_type);
-    d++;
-
-    /* The second element is the symbol for the opcode. */
-    d->type = SYMBOL;
-    d->u.symbol = ident_dup(op_table[cur_frame->last_opcode].symbol);
+    /* The location is 'function or 'opcode, and the opcode's symbol. */
+    traceback = traceback_new(location_type, error, explanation, NULL);
+    traceback->location_opcode =
+	ident_dup(op_table[cur_frame->last_opcode].symbol);
 
-    start_error(error, explanation, NULL, location);
-    list_discard(location);
+    propagate_error(traceback, error);
 }
 
 void user_error(Ident error, String *explanation, Data *arg)
 {
-    List *location;
-    Data *d;
-
-    /* Construct a list giving the location. */
-    location = list_new(5);
-    d = list_empty_spaces(location, 5);
-
-    /* The first element is 'method. */
-    d->type = SYMBOL;
-    d->u.symbol = ident_dup(method_id);
-    d++;
+    Traceback *traceback;
 
-    /* The second through fifth elements are the current method info. */
-    fill_in_method_info(d);
+    /* The location is 'method, and the current method info. */
+    traceback = traceback_new(method_id, error, explanation, arg);
+    record_site(&traceback->location, cur_frame);
 
     /* Return from the current method, and propagate the error. */
-    frame_return();
-    start_error(error, explanation, arg, location);
-    list_discard(location);
+    propagate_error(traceback, frame_return_error(traceback, error));
 }
 
 static void out_of_ticks_error(void)
 {
     static String *explanation;
-    List *location;
-    Data *d;
-
-    /* Construct a list giving the location. */
-    location = list_new(5);
-    d = list_empty_spaces(location, 5);
-
-    /* The first element is 'interpreter. */
-    d->type = SYMBOL;
-    d->u.symbol = ident_dup(interpreter_id);
-    d++;
-
-    /* The second through fifth elements are the current method info. */
-    fill_in_method_info(d);
-
-    /* Don't give the topmost frame a chance to return. */
-    frame_return();
+    Traceback *traceback;
 
     if (!explanation)
 	explanation = string_from_chars("Out of ticks", 12);
-    start_error(methoderr_id, explanation, NULL, location);
-    list_discard(location);
-}
 
-static void start_error(Ident error, String *explanation, Data *arg,
-			List *location)
-{
-    List *error_condition, *traceback;
-    Data *d;
-
-    /* Construct a three-element list for the error condition. */
-    error_condition = list_new(3);
-    d = list_empty_spaces(error_condition, 3);
+    /* The location is 'interpreter, and the current method info. */
+    traceback = traceback_new(interpreter_id, methoderr_id, explanation, NULL);
+    record_site(&traceback->location, cur_frame);
 
-    /* The first element is the error code. */
-    d->type = ERROR;
-    d->u.error = ident_dup(error);
-    d++;
-
-    /* The second element is the explanation string. */
-    d->type = STRING;
-    d->u.str = string_dup(explanation);
-    d++;
-
-    /* The third element is the error arg, or 0 if there is none. */
-    if (arg) {
-	data_dup(d, arg);
-    } else {
-	d->type = INTEGER;
-	d->u.val = 0;
-    }
-
-    /* Now construct a traceback, starting as a two-element list. */
-    traceback = list_new(2);
-    d = list_empty_spaces(traceback, 2);
-
-    /* The first element is the error condition. */
-    d->type = LIST;
-    d->u.list = error_condition;
-    d++;
-
-    /* The second argument is the location. */
-    d->type = LIST;
-    d->u.list = list_dup(location);
-
-    /* Start the error propagating.  This consumes traceback. */
-    propagate_error(traceback, error);
+    /* Don't give the topmost frame a chance to return. */
+    propagate_error(traceback, frame_return_error(traceback, methoderr_id));
 }
 
-/* Requires:	traceback is a list of strings containing the traceback
- *			information to date.  THIS FUNCTION CONSUMES TRACEBACK.
+/* Requires:	traceback is the traceback information to date.  THIS
+ *			FUNCTION CONSUMES TRACEBACK.
  *		id is an error id.  This function accounts for an error id
  *			which is "owned" by a data stack frame that we will
- *			nuke in the course of unwinding the call stack.
- *		str is a string containing an explanation of the error. */
-void propagate_error(List *traceback, Ident error)
+ *			nuke in the course of unwinding the call stack. */
+void propagate_error(Traceback *traceback, Ident error)
 {
-    int i, ind, propagate = 0;
+    int i, ind, propagate;
     Error_action_specifier *spec;
     Error_list *errors;
     Handler_info *hinfo;
 
-    /* If there's no current frame, drop all this on the floor. */
-    if (!cur_frame) {
-	list_discard(traceback);
-	return;
-    }
+    /* Unwind frames until one handles the error, looping rather than
+     * recursing so that deep call stacks don't use up the C stack. */
+    while (cur_frame) {
+	propagate = 0;
 
-    /* Add message to traceback. */
-    traceback = traceback_add(traceback, error);
+	/* Add this frame to the traceback. */
+	traceback_add(traceback, error);
 
-    /* Look for an appropriate specifier in this frame. */
-    for (; cur_frame->specifiers; pop_error_action_specifier()) {
+	/* Look for an appropriate specifier in this frame. */
+	for (; cur_frame->specifiers; pop_error_action_specifier()) {
 
-	spec = cur_frame->specifiers;
-	switch (spec->type) {
+	    spec = cur_frame->specifiers;
+	    switch (spec->type) {
 
-	  case CRITICAL:
+	      case CRITICAL:
 
-	    /* We're in a critical expression.  Make a copy of the error,
-	     * since it may currently be living in the region of the stack
-	     * we're about to nuke. */
-	    error = ident_dup(error);
+		/* We're in a critical expression.  Make a copy of the error,
+		 * since it may currently be living in the region of the stack
+		 * we're about to nuke. */
+		error = ident_dup(error);
 
-	    /* Nuke the stack back to where we were at the beginning of the
-	     * critical expression. */
-	    pop(stack_pos - spec->stack_pos);
+		/* Nuke the stack back to where we were at the beginning of the
+		 * critical expression. */
+		pop(stack_pos - spec->stack_pos);
 
-	    /* Jump to the end of the critical expression. */
-	    cur_frame->pc = spec->u.critical.end;
+		/* Jump to the end of the critical expression. */
+		frame_jump(spec->u.critical.end);
 
-	    /* Push the error on the stack, and discard our copy of it. */
-	    push_error(error);
-	    ident_discard(error);
+		/* Push the error on the stack, and discard our copy of it. */
+		push_error(error);
+		ident_discard(error);
 
-	    /* Pop this error spec, discard the traceback, and continue
-	     * processing. */
-	    pop_error_action_specifier();
-	    list_discard(traceback);
-	    return;
+		/* Pop this error spec, discard the traceback, and continue
+		 * processing. */
+		pop_error_action_specifier();
+		traceback_discard(traceback);
+		return;
 
-	  case PROPAGATE:
+	      case PROPAGATE:
 
-	    /* We're in a propagate expression.  Set the propagate flag and
-	     * keep going. */
-	    propagate = 1;
-	    break;
+		/* We're in a propagate expression.  Set the propagate flag and
+		 * keep going. */
+		propagate = 1;
+		break;
 
-	  case CATCH:
+	      case CATCH:
 
-	    /* We're in a catch statement.  Get the error list index. */
-	    ind = spec->u.catch.error_list;
+		/* We're in a catch statement.  Get the error list index. */
+		ind = spec->u.catch.error_list;
 
-	    /* If the index is -1, this was a 'catch any' statement.
-	     * Otherwise, check if this error code is in the error list. */
-	    if (spec->u.catch.error_list != -1) {
-		errors = &cur_frame->method->error_lists[ind];
-		for (i = 0; i < errors->num_errors; i++) {
-		    if (errors->error_ids[i] == error)
+		/* If the index is -1, this was a 'catch any' statement.
+		 * Otherwise, check if this error code is in the error list. */
+		if (spec->u.catch.error_list != -1) {
+		    errors = &cur_frame->method->error_lists[ind];
+		    for (i = 0; i < errors->num_errors; i++) {
+			if (errors->error_ids[i] == error)
+			    break;
+		    }
+
+		    /* Keep going if we didn't find the error. */
+		    if (i == errors->num_errors)
 			break;
 		}
 
-		/* Keep going if we didn't find the error. */
-		if (i == errors->num_errors)
-		    break;
+		/* We catch this error.  Make a handler info structure and push
+		 * it onto the stack. */
+		hinfo = EMALLOC(Handler_info, 1);
+		hinfo->traceback = traceback;
+		hinfo->error = ident_dup(error);
+		hinfo->next = cur_frame->handler_info;
+		cur_frame->handler_info = hinfo;
+
+		/* Pop the stack down to where we were at the beginning of the
+		 * catch statement.  This may nuke our copy of error, but we
+		 * don't need it any more. */
+		pop(stack_pos - spec->stack_pos);
+
+		/* Jump to the handler expression, pop this specifier, and
+		 * continue processing. */
+		frame_jump(spec->u.catch.handler);
+		pop_error_action_specifier();
+		return;
+
 	    }
+	}
 
-	    /* We catch this error.  Make a handler info structure and push it
-	     * onto the stack. */
-	    hinfo = EMALLOC(Handler_info, 1);
-	    hinfo->traceback = traceback;
-	    hinfo->error = ident_dup(error);
-	    hinfo->next = cur_frame->handler_info;
-	    cur_frame->handler_info = hinfo;
-
-	    /* Pop the stack down to where we were at the beginning of the
-	     * catch statement.  This may nuke our copy of error, but we don't
-	     * need it any more. */
-	    pop(stack_pos - spec->stack_pos);
-
-	    /* Jump to the handler expression, pop this specifier, and continue
-	     * processing. */
-	    cur_frame->pc = spec->u.catch.handler;
-	    pop_error_action_specifier();
-	    return;
+	/* There was no handler in the current frame.  The caller gets
+	 * ~methoderr unless we were in a propagate expression. */
+	if (!propagate)
+	    error = methoderr_id;
+	error = frame_return_error(traceback, error);
+    }
 
-	}
+    /* There's no frame left, so drop all this on the floor. */
+    traceback_discard(traceback);
+}
+
+/* Effects:	Returns a new traceback for the error condition [error,
+ *		explanation, arg] with no sites, and a location of type
+ *		location_type for the caller to fill in.  The error arg is 0 if
+ *		arg is NULL. */
+static Traceback *traceback_new(Ident location_type, Ident error,
+				String *explanation, Data *arg)
+{
+    Traceback *traceback;
+
+    traceback = EMALLOC(Traceback, 1);
+    traceback->error = ident_dup(error);
+    traceback->explanation = string_dup(explanation);
+    if (arg) {
+	data_dup(&traceback->arg, arg);
+    } else {
+	traceback->arg.type = INTEGER;
+	traceback->arg.u.val = 0;
     }
+    traceback->location_type = ident_dup(location_type);
+    traceback->location_opcode = NOT_AN_IDENT;
+    traceback->location.method = NULL;
+    traceback->num_sites = 0;
+    traceback->sites_size = 0;
+    traceback->sites = NULL;
+    traceback->list = NULL;
+    return traceback;
+}
 
-    /* There was no handler in the current frame. */
-    frame_return();
-    propagate_error(traceback, (propagate) ? error : methoderr_id);
+/* Modifies:	traceback.
+ * Effects:	Records the current frame as the next site the error passed
+ *		through.  Nothing is formatted until traceback_list(). */
+static void traceback_add(Traceback *traceback, Ident error)
+{
+    record_site(traceback_new_site(traceback, error), cur_frame);
+}
+
+/* Modifies:	traceback.
+ * Effects:	Returns the next site in traceback, with error filled in and
+ *		the method info left for the caller. */
+static Error_site *traceback_new_site(Traceback *traceback, Ident error)
+{
+    Error_site *site;
+
+    if (traceback->list) {
+	list_discard(traceback->list);
+	traceback->list = NULL;
+    }
+
+    if (traceback->num_sites == traceback->sites_size) {
+	traceback->sites_size = traceback->sites_size * 2 + SITES_MALLOC_DELTA;
+	traceback->sites = EREALLOC(traceback->sites, Error_site,
+				    traceback->sites_size);
+    }
+
+    site = &traceback->sites[traceback->num_sites++];
+    site->error = ident_dup(error);
+    return site;
+}
+
+/* Modifies:	site.
+ * Effects:	Remembers frame's method and position in site, so that
+ *		fill_in_site_info() can describe it later.  The site holds the
+ *		defining object as well as the method, since the cache frees an
+ *		object's methods when it swaps the object out. */
+static void record_site(Error_site *site, Frame *frame)
+{
+    site->method = method_grab(frame->method);
+    cache_grab(frame->method->object);
+    site->object = frame->object->dbref;
+    site->definer = frame->method->object->dbref;
+    site->pc = frame->pc;
+}
+
+/* Modifies:	dest.
+ * Effects:	Copies the site src into dest, other than its error. */
+static void copy_site(Error_site *dest, Error_site *src)
+{
+    dest->method = method_grab(src->method);
+    cache_grab(src->method->object);
+    dest->object = src->object;
+    dest->definer = src->definer;
+    dest->pc = src->pc;
+}
+
+/* Effects:	Lets go of the method and defining object site holds. */
+static void site_discard(Error_site *site)
+{
+    Object *definer = site->method->object;
+
+    method_discard(site->method);
+    cache_discard(definer);
 }
 
-static List *traceback_add(List *traceback, Ident error)
+/* Effects:	Returns the traceback as a C-- list: the error condition
+ *		[error, explanation, arg], then the location, then a list for
+ *		each site.  The list belongs to traceback, so the caller
+ *		should dup it to keep it. */
+List *traceback_list(Traceback *traceback)
 {
-    List *frame;
-    Data *d, frame_data;
+    List *list, *l;
+    Data *d, *e;
+    int i;
 
-    /* Construct a list giving information about this stack frame. */
-    frame = list_new(5);
-    d = list_empty_spaces(frame, 5);
+    if (traceback->list)
+	return traceback->list;
 
-    /* First element is the error code. */
-    d->type = ERROR;
-    d->u.error = ident_dup(error);
+    list = list_new(traceback->num_sites + 2);
+    d = list_empty_spaces(list, traceback->num_sites + 2);
+
+    /* The first element is the error condition. */
+    l = list_new(3);
+    e = list_empty_spaces(l, 3);
+    e->type = ERROR;
+    e->u.error = ident_dup(traceback->error);
+    e++;
+    e->type = STRING;
+    e->u.str = string_dup(traceback->explanation);
+    e++;
+    data_dup(e, &traceback->arg);
+    d->type = LIST;
+    d->u.list = l;
     d++;
 
-    /* Second through fifth elements are the current method info. */
-    fill_in_method_info(d);
+    /* The second is the location: a function or opcode symbol, or method
+     * info. */
+    if (traceback->location.method) {
+	l = list_new(5);
+	e = list_empty_spaces(l, 5);
+	e->type = SYMBOL;
+	e->u.symbol = ident_dup(traceback->location_type);
+	fill_in_site_info(e + 1, &traceback->location);
+    } else {
+	l = list_new(2);
+	e = list_empty_spaces(l, 2);
+	e->type = SYMBOL;
+	e->u.symbol = ident_dup(traceback->location_type);
+	e++;
+	e->type = SYMBOL;
+	e->u.symbol = ident_dup(traceback->location_opcode);
+    }
+    d->type = LIST;
+    d->u.list = l;
+    d++;
 
-    /* Add the frame to the list. */
-    frame_data.type = LIST;
-    frame_data.u.list = frame;
-    traceback = list_add(traceback, &frame_data);
-    list_discard(frame);
+    /* The rest give the error code and method info for each site. */
+    for (i = 0; i < traceback->num_sites; i++, d++) {
+	l = list_new(5);
+	e = list_empty_spaces(l, 5);
+	e->type = ERROR;
+	e->u.error = ident_dup(traceback->sites[i].error);
+	fill_in_site_info(e + 1, &traceback->sites[i]);
+	d->type = LIST;
+	d->u.list = l;
+    }
 
-    return traceback;
+    traceback->list = list;
+    return list;
+}
+
+void traceback_discard(Traceback *traceback)
+{
+    int i;
+
+    ident_discard(traceback->error);
+    string_discard(traceback->explanation);
+    data_discard(&traceback->arg);
+    ident_discard(traceback->location_type);
+    if (traceback->location_opcode != NOT_AN_IDENT)
+	ident_discard(traceback->location_opcode);
+    if (traceback->location.method)
+	site_discard(&traceback->location);
+    for (i = 0; i < traceback->num_sites; i++) {
+	ident_discard(traceback->sites[i].error);
+	site_discard(&traceback->sites[i]);
+    }
+    free(traceback->sites);
+    if (traceback->list)
+	list_discard(traceback->list);
+    free(traceback);
 }
 
 void pop_error_action_specifier()
@@ -815,39 +1816,40 @@ void pop_handler_info()
     /* Free the data in the first handler info specifier, and pop it off that
      * stack. */
     old = cur_frame->handler_info;
-    list_discard(old->traceback);
+    if (old->traceback)
+	traceback_discard(old->traceback);
     ident_discard(old->error);
     cur_frame->handler_info = old->next;
     free(old);
 }
 
-static void fill_in_method_info(Data *d)
+static void fill_in_site_info(Data *d, Error_site *site)
 {
     Ident method_name;
 
     /* The method name, or 0 for eval. */
-    method_name = cur_frame->method->name;
+    method_name = site->method->name;
     if (method_name == NOT_AN_IDENT) {
 	d->type = INTEGER;
 	d->u.val = 0;
     } else {
 	d->type = SYMBOL;
-	d->u.val = method_name;
+	d->u.symbol = ident_dup(method_name);
     }
     d++;
 
     /* The current object. */
     d->type = DBREF;
-    d->u.dbref = cur_frame->object->dbref;
+    d->u.dbref = site->object;
     d++;
 
     /* The defining object. */
     d->type = DBREF;
-    d->u.dbref = cur_frame->method->object->dbref;
+    d->u.dbref = site->definer;
     d++;
 
     /* The line number. */
     d->type = INTEGER;
-    d->u.val = line_number(cur_frame->method, cur_frame->pc);
+    d->u.val = line_number(site->method, site->pc);
 }
 
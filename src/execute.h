@@ -6,6 +6,10 @@
 typedef struct frame Frame;
 typedef struct error_action_specifier Error_action_specifier;
 typedef struct handler_info Handler_info;
+typedef struct error_site Error_site;
+typedef struct traceback Traceback;
+typedef struct task Task;
+typedef struct jump_counts Jump_counts;
 
 #include <sys/types.h>
 #include <stdarg.h>
@@ -18,22 +22,51 @@ typedef struct handler_info Handler_info;
 #define STACK_MALLOC_DELTA 4
 #define ARG_STACK_MALLOC_DELTA 8
 
+/* The instruction counts at both ends of a jump. */
+struct jump_counts {
+    int from, to;
+    int from_count, to_count;
+};
+
 struct frame {
     Object *object;
     Dbref sender;
     Dbref caller;
     Method *method;
-    long *opcodes;
+    Opcode *opcodes;
     int pc;
     int last_opcode;
-    int ticks;
+    int ticks;			/* Ticks left, plus method_count() at pc. */
+    Jump_counts jump;		/* The last forward jump; see frame_jump(). */
+    Jump_counts loop;		/* The last jump back to a loop's top. */
     int stack_start;
     int var_start;
     Error_action_specifier *specifiers;
     Handler_info *handler_info;
+    Error_site *elided;		/* Frames replaced by tail calls. */
+    int num_elided;
+    int elided_size;
     Frame *caller_frame;
 };
 
+/* A task which is not running keeps its frames and stacks here.  The running
+ * task's are in the globals declared below. */
+struct task {
+    long id;
+    Connection *conn;
+    Frame *frame;		/* Innermost frame, or NULL when finished. */
+    int frame_depth;
+    int elided_count;		/* Frames replaced by tail calls. */
+    Data *stack;
+    int stack_pos;
+    int stack_size;
+    int *arg_starts;
+    int arg_pos;
+    int arg_size;
+    int suspended;		/* Waiting for resume(). */
+    Task *next;
+};
+
 struct error_action_specifier {
     int type;
     int stack_pos;
@@ -52,8 +85,31 @@ struct error_action_specifier {
     Error_action_specifier *next;
 };
 
+/* A place an error passed through.  The line number and the traceback list
+ * are only worked out if the handler asks for them. */
+struct error_site {
+    Ident error;
+    Method *method;
+    Dbref object;
+    Dbref definer;
+    int pc;
+};
+
+struct traceback {
+    Ident error;
+    String *explanation;
+    Data arg;
+    Ident location_type;
+    Ident location_opcode;	/* For 'function and 'opcode locations. */
+    Error_site location;	/* For 'method and 'interpreter locations. */
+    int num_sites;
+    int sites_size;
+    Error_site *sites;
+    List *list;			/* Cached result of traceback_list(). */
+};
+
 struct handler_info {
-    List *traceback;
+    Traceback *traceback;
     Ident error;
     Handler_info *next;
 };
@@ -69,12 +125,33 @@ extern long task_id;
 void init_execute(void);
 void task(Connection *conn, Dbref dbref, long message, int num_args, ...);
 void task_method(Connection *conn, Object *obj, Method *method);
+void task_query(Dbref dbref, Ident message, List *args, Data *result);
+void task_return(Data *val);
+void run_tasks(void);
+int tasks_runnable(void);
+int tasks_pending(void);
+int tasks_next_wake(void);
+void wake_tasks(void);
+long task_fork(int pc, long delay);
+long task_schedule(long delay, Dbref dbref, Ident message, List *args);
+void task_suspend(void);
+int task_atomic(void);
+int task_resume(long id, Data *value);
+int task_cancel(long id);
+void task_forget_connection(Connection *conn);
 long frame_start(Object *obj, Method *method, Dbref sender, Dbref caller,
 		 int stack_start, int arg_start);
 void frame_return(void);
+void frame_tail_call(void);
+Ident frame_return_error(Traceback *traceback, Ident error);
+void frame_jump(int target);
+void frame_loop(int target);
+int frame_charge(long n);
+void quicken(int pos, int opcode);
 void anticipate_assignment(void);
 Ident pass_message(int stack_start, int arg_start);
-Ident send_message(Dbref dbref, Ident message, int stack_start, int arg_start);
+Ident send_message(Dbref dbref, Ident message, int stack_start, int arg_start,
+		   Message_cache *cache);
 void pop(int n);
 void check_stack(int n);
 void push_int(long n);
@@ -93,6 +170,8 @@ int func_init_0_or_1(Data **args, int *num_args, int type1);
 int func_init_1_or_2(Data **args, int *num_args, int type1, int type2);
 int func_init_2_or_3(Data **args, int *num_args, int type1, int type2,
 		     int type3);
+int func_init_3_or_4(Data **args, int *num_args, int type1, int type2,
+		     int type3, int type4);
 int func_init_1_to_3(Data **args, int *num_args, int type1, int type2,
 		     int type3);
 void func_num_error(int num_args, char *required);
@@ -102,7 +181,9 @@ void throw(long id, char *fmt, ...);
 void unignorable_error(Ident id, String *str);
 void interp_error(Ident error, String *str);
 void user_error(Ident error, String *str, Data *arg);
-void propagate_error(List *traceback, Ident error);
+void propagate_error(Traceback *traceback, Ident error);
+List *traceback_list(Traceback *traceback);
+void traceback_discard(Traceback *traceback);
 void pop_error_action_specifier(void);
 void pop_handler_info(void);
 
@@ -56,7 +56,7 @@ extern Pile *compiler_pile;	/* We free this pile after compilation. */
 %token		IF FOR IN UPTO WHILE SWITCH CASE DEFAULT
 %token		BREAK CONTINUE RETURN
 %token		CATCH ANY HANDLER
-%token		FORK
+%token		FORK ATOMIC
 %token		PASS CRITLEFT CRITRIGHT PROPLEFT PROPRIGHT
 
 %left	TO
@@ -87,7 +87,8 @@ extern Pile *compiler_pile;	/* We free this pile after compilation. */
 %token FUNCTION_CALL MESSAGE EXPR_MESSAGE LIST DICT BUFFER FROB INDEX UNARY
 %token BINARY CONDITIONAL SPLICE NEG SPLICE_ADD POP START_ARGS ZERO ONE
 %token SET_LOCAL SET_OBJ_VAR GET_LOCAL GET_OBJ_VAR CATCH_END HANDLER_END
-%token CRITICAL CRITICAL_END PROPAGATE PROPAGATE_END JUMP
+%token CRITICAL CRITICAL_END PROPAGATE PROPAGATE_END JUMP FORK_END
+%token ATOMIC_END
 
 %token TYPE CLASS TOINT TOSTR TOLITERAL TODBREF TOSYM TOERR VALID
 %token STRLEN SUBSTR EXPLODE STRSUB PAD MATCH_BEGIN MATCH_TEMPLATE
@@ -105,10 +106,27 @@ extern Pile *compiler_pile;	/* We free this pile after compilation. */
 %token CHILDREN ANCESTORS HAS_ANCESTOR SIZE
 %token CREATE CHPARENTS DESTROY LOG CONN_ASSIGN BINARY_DUMP TEXT_DUMP
 %token RUN_SCRIPT SHUTDOWN BIND UNBIND CONNECT SET_HEARTBEAT_FREQ DATA SET_NAME
-%token DEL_NAME DB_TOP
+%token DEL_NAME DB_TOP METHOD_CACHE_STATS CREATE_MANY DESTROY_MANY
+%token SUSPEND RESUME CANCEL SCHEDULE QUERY CANCEL_QUERY
+
+/* Superinstructions, generated by the peephole pass in codegen.c. */
+%token GET_LOCAL_LOCAL ADD_INTEGER SUBTRACT_INTEGER MULTIPLY_INTEGER
+%token DIVIDE_INTEGER LESS_INTEGER
+
+/* Quickened instructions, which quicken() in execute.c writes over general
+ * ones once it has seen the types of their operands. */
+%token ADD_INT_INT SUBTRACT_INT_INT EQUAL_INT_INT NOT_EQUAL_INT_INT
+%token GREATER_INT_INT GREATER_OR_EQUAL_INT_INT LESS_INT_INT
+%token LESS_OR_EQUAL_INT_INT FOR_LIST_LIST INDEX_LIST_INT
+
+/* Integer constants too wide for a 32-bit opcode argument. */
+%token BIG_INTEGER
+
+/* Messages and passes whose results are returned directly. */
+%token TAIL_PASS TAIL_MESSAGE TAIL_EXPR_MESSAGE
 
 /* Reserved for future use. */
-%token FORK ATOMIC NON_ATOMIC
+%token NON_ATOMIC
 
 /* LAST_TOKEN tells opcodes.c how much space to allocate for the opcodes
  * table. */
@@ -177,6 +195,8 @@ stmt	: COMMENT			{ $$ = comment_stmt($1); }
 					{ $$ = catch_stmt($2, $3, NULL); }
 	| CATCH errors stmt WITH HANDLER stmt
 					{ $$ = catch_stmt($2, $3, $6); }
+	| FORK '(' expr ')' stmt	{ $$ = fork_stmt($3, $5); }
+	| ATOMIC stmt			{ $$ = atomic_stmt($2); }
 	| error ';'			{ yyerrok; $$ = NULL; }
 	;
 
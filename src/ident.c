@@ -21,10 +21,15 @@ typedef struct ident_entry Ident_entry;
 
 struct ident_entry {
     char *s;
+    unsigned long hval;		/* Cached hash value of s. */
     int refs;
     long next;
 };
 
+/* The identifier dictionary in db.c keeps room for every identifier in the
+ * table. */
+extern void db_reserve_idents(long size);
+
 static Ident_entry *tab;
 static long *hashtab;
 static long tab_size, blanks;
@@ -36,7 +41,7 @@ Ident ticks_id, connect_id, disconnect_id, startup_id, parse_id, socket_id;
 Ident bind_id, servnf_id, paramexists_id, dictionary_id, keynf_id, address_id;
 Ident refused_id, net_id, timeout_id, other_id, failed_id, heartbeat_id;
 Ident regexp_id, buffer_id, namenf_id, salt_id, function_id, opcode_id;
-Ident method_id, interpreter_id;
+Ident method_id, interpreter_id, tasknf_id, query_id;
 
 void init_ident(void)
 {
@@ -55,6 +60,7 @@ void init_ident(void)
     tab[tab_size - 1].next = -1;
 
     blanks = 0;
+    db_reserve_idents(tab_size);
 
     perm_id = ident_get("perm");
     type_id = ident_get("type");
@@ -101,6 +107,8 @@ void init_ident(void)
     opcode_id = ident_get("opcode");
     method_id = ident_get("method");
     interpreter_id = ident_get("interpreter");
+    tasknf_id = ident_get("tasknf");
+    query_id = ident_get("query");
 }
 
 Ident ident_get(char *s)
@@ -141,18 +149,20 @@ Ident ident_get(char *s)
 
 	/* Install old symbols in hash table. */
 	for (i = 0; i < tab_size; i++) {
-	    ind = hash(tab[i].s) % new_size;
+	    ind = tab[i].hval % new_size;
 	    tab[i].next = hashtab[ind];
 	    hashtab[ind] = i;
 	}
 
 	tab_size = new_size;
+	db_reserve_idents(tab_size);
     }
 
     /* Install symbol at first blank. */
     ind = blanks;
     blanks = tab[ind].next;
     tab[ind].s = tstrdup(s);
+    tab[ind].hval = hval;
     tab[ind].refs = 1;
     tab[ind].next = hashtab[hval % tab_size];
     hashtab[hval % tab_size] = ind;
@@ -173,7 +183,7 @@ void ident_discard(Ident id)
 #endif
     if (!tab[id].refs) {
 	/* Get the hash table thread for this entry. */
-	ind = hash(tab[id].s) % tab_size;
+	ind = tab[id].hval % tab_size;
 
 	/* Free the string. */
 	tfree_chars(tab[id].s);
@@ -203,3 +213,10 @@ char *ident_name(Ident id)
     return tab[id].s;
 }
 
+/* Returns the same value as hash(ident_name(id)), without rehashing the
+ * identifier's name. */
+unsigned long ident_hash(Ident id)
+{
+    return tab[id].hval;
+}
+
@@ -7,6 +7,10 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include "x.tab.h"
 #include "io.h"
 #include "net.h"
@@ -17,6 +21,8 @@
 #include "data.h"
 #include "util.h"
 #include "ident.h"
+#include "db.h"
+#include "config.h"
 
 #define BUF_SIZE 1024
 
@@ -26,17 +32,26 @@ static Connection *connection_add(int fd, long dbref);
 static void connection_discard(Connection *conn);
 static void pend_discard(Pending *pend);
 static void server_discard(Server *serv);
+static void query_run(int fd, Dbref dbref, Ident message, List *args);
+static void query_read(Query *query);
+static void query_kill(Query *query);
+static void query_finish(Query *query);
+static void query_discard(Query *query);
 
 static Connection *connections;		/* List of client connections. */
 static Server *servers;			/* List of server sockets. */
 static Pending *pendings;		/* List of pending connections. */
+static Query *queries;			/* List of running queries. */
+static long next_query_id;
 
-/* Notify the system object of any dead connections and delete them. */
+/* Notify the system object of any dead connections and delete them, and send
+ * the results of finished queries. */
 void flush_defunct(void)
 {
     Connection **connp, *conn;
     Server **servp, *serv;
     Pending **pendp, *pend;
+    Query **queryp, *query;
 
     connp = &connections;
     while (*connp) {
@@ -70,6 +85,18 @@ void flush_defunct(void)
 	    pendp = &pend->next;
 	}
     }
+
+    /* Send the results of finished queries. */
+    queryp = &queries;
+    while (*queryp) {
+	query = *queryp;
+	if (query->finished) {
+	    *queryp = query->next;
+	    query_discard(query);
+	} else {
+	    queryp = &query->next;
+	}
+    }
 }
 
 /* Handle any I/O events.  sec is the number of seconds we get to wait for
@@ -80,6 +107,7 @@ void handle_io_events(long sec)
     Connection *conn;
     Server *serv;
     Pending *pend;
+    Query *query;
     String *str;
     Data d1, d2;
 
@@ -87,7 +115,7 @@ void handle_io_events(long sec)
      * is nonzero if an I/O event occurred.  If thre is a new connection, then
      * *fd will be set to the descriptor of the new connection; otherwise, it
      * is set to -1. */
-    if (!io_event_wait(sec, connections, servers, pendings))
+    if (!io_event_wait(sec, connections, servers, pendings, queries))
 	return;
 
     /* Deal with any events on our existing connections. */
@@ -131,6 +159,13 @@ void handle_io_events(long sec)
 	    }
 	}
     }
+
+    /* Read results from query processes.  A task above may have waited for
+     * a query to finish already. */
+    for (query = queries; query; query = query->next) {
+	if (query->readable && !query->finished)
+	    query_read(query);
+    }
 }
 
 void tell(long dbref, Buffer *buf)
@@ -259,6 +294,7 @@ static Connection *connection_add(int fd, long dbref)
     conn->fd = fd;
     conn->write_buf = buffer_new(0);
     conn->dbref = dbref;
+    conn->waiting_tasks = 0;
     conn->flags.readable = 0;
     conn->flags.writable = 0;
     conn->flags.dead = 0;
@@ -271,6 +307,7 @@ static void connection_discard(Connection *conn)
 {
     /* Notify system object that the connection is gone. */
     task(conn, conn->dbref, disconnect_id, 0);
+    task_forget_connection(conn);
 
     /* Free the data associated with the connection. */
     close(conn->fd);
@@ -308,6 +345,227 @@ long make_connection(char *addr, int port, Dbref receiver)
     return NOT_AN_IDENT;
 }
 
+/* Modifies:	The database files, via db_freeze().
+ * Effects:	Starts a query, a process forked from the server which sends
+ *		message to dbref with the arguments in args, and writes the
+ *		result back to us as a literal.  The process has a copy of the
+ *		server's memory, and the database files don't change on disk
+ *		until it has finished, so it sees the database as it is now,
+ *		and any changes it makes are lost.  The result goes to receiver
+ *		in a 'query message with the query's ID.  Returns the ID, or -1
+ *		if the process couldn't be started. */
+long make_query(Dbref dbref, Ident message, List *args, Dbref receiver)
+{
+    Query *new;
+    int fds[2];
+    pid_t pid;
+
+    if (pipe(fds) == -1)
+	return -1;
+
+    db_freeze();
+    pid = fork();
+    if (pid == -1) {
+	close(fds[0]);
+	close(fds[1]);
+	db_thaw();
+	return -1;
+    } else if (pid == 0) {
+	close(fds[0]);
+	query_run(fds[1], dbref, message, args);
+    }
+    close(fds[1]);
+
+    new = EMALLOC(Query, 1);
+    new->fd = fds[0];
+    new->pid = pid;
+    new->id = next_query_id++;
+    new->dbref = receiver;
+    new->result = string_new(0);
+    new->readable = 0;
+    new->finished = 0;
+    new->started = time(NULL);
+    new->next = queries;
+    queries = new;
+    return new->id;
+}
+
+/* Modifies:	The running queries, the database files.
+ * Effects:	Kills the query process with the ID id, so that its receiver
+ *		gets ~query when flush_defunct() is next called.  Returns 0 if
+ *		there is no such query running, or 1 if there is. */
+int cancel_query(long id)
+{
+    Query *query;
+
+    for (query = queries; query; query = query->next) {
+	if (query->id == id && !query->finished) {
+	    query_kill(query);
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/* Modifies:	The running queries, the database files.
+ * Effects:	Kills the running query processes, so that the database files
+ *		can be written.  Their receivers get ~query when
+ *		flush_defunct() is next called. */
+void cancel_queries(void)
+{
+    Query *query;
+
+    for (query = queries; query; query = query->next)
+	query_kill(query);
+}
+
+/* Modifies:	The running queries, the database files.
+ * Effects:	Kills the query processes which have run for QUERY_TIMEOUT
+ *		seconds. */
+void expire_queries(void)
+{
+    Query *query;
+    time_t t;
+
+    time(&t);
+    for (query = queries; query; query = query->next) {
+	if (t >= query->started + QUERY_TIMEOUT)
+	    query_kill(query);
+    }
+}
+
+/* Effects:	Returns the number of seconds until expire_queries() should
+ *		next be called, or -1 if there are no queries running. */
+int queries_next_timeout(void)
+{
+    Query *query;
+    time_t t, next = 0;
+
+    for (query = queries; query; query = query->next) {
+	if (!query->finished && (!next || query->started < next))
+	    next = query->started;
+    }
+    if (!next)
+	return -1;
+    next += QUERY_TIMEOUT;
+    time(&t);
+    return (t >= next) ? 0 : next - t;
+}
+
+/* Requires:	We are in a new query process, and fd is the write end of its
+ *		pipe.
+ * Effects:	Runs the query and writes the result to fd, then exits. */
+static void query_run(int fd, Dbref dbref, Ident message, List *args)
+{
+    Connection *conn;
+    Server *serv;
+    Pending *pend;
+    Query *query;
+    Data result;
+    String *str;
+    char *s;
+    int len, r;
+
+    /* Let go of the server's descriptors, so that when the server closes
+     * one, it really closes.  Finished records' descriptors are closed
+     * already, and their numbers may have gone to our pipe. */
+    for (conn = connections; conn; conn = conn->next)
+	close(conn->fd);
+    for (serv = servers; serv; serv = serv->next)
+	close(serv->server_socket);
+    for (pend = pendings; pend; pend = pend->next) {
+	if (!pend->finished)
+	    close(pend->fd);
+    }
+    for (query = queries; query; query = query->next) {
+	if (!query->finished)
+	    close(query->fd);
+    }
+
+    db_snapshot();
+    task_query(dbref, message, args, &result);
+    str = data_to_literal(&result);
+
+    s = string_chars(str);
+    len = string_length(str);
+    while (len) {
+	r = write(fd, s, len);
+	if (r < 0 && errno == EINTR)
+	    continue;
+	if (r <= 0)
+	    _exit(1);
+	len -= r;
+	s += r;
+    }
+
+    /* Leave without flushing stdio buffers we share with the server. */
+    _exit(0);
+}
+
+static void query_read(Query *query)
+{
+    char temp[BUF_SIZE];
+    int len;
+
+    len = read(query->fd, temp, BUF_SIZE);
+    if (len < 0 && errno == EINTR) {
+	/* We were interrupted; deal with this next time around. */
+	return;
+    }
+    query->readable = 0;
+
+    if (len > 0) {
+	query->result = string_add_chars(query->result, temp, len);
+	return;
+    }
+
+    query_finish(query);
+}
+
+/* Modifies:	query, the database files.
+ * Effects:	Kills query's process if it is still running.  It can't have
+ *		exited normally, so the receiver gets ~query. */
+static void query_kill(Query *query)
+{
+    if (query->finished)
+	return;
+    kill(query->pid, SIGKILL);
+    query_finish(query);
+}
+
+/* Modifies:	query, the database files.
+ * Effects:	Reaps query's process, which has finished or been killed. */
+static void query_finish(Query *query)
+{
+    /* The process is gone, so the database files can change. */
+    close(query->fd);
+    waitpid(query->pid, &query->status, 0);
+    query->finished = 1;
+    db_thaw();
+}
+
+static void query_discard(Query *query)
+{
+    Data d1, d2;
+
+    /* If the process didn't finish writing the result, send ~query. */
+    d2.type = -1;
+    if (WIFEXITED(query->status) && WEXITSTATUS(query->status) == 0)
+	data_from_literal(&d2, string_chars(query->result));
+    if (d2.type == -1) {
+	d2.type = ERROR;
+	d2.u.error = ident_dup(query_id);
+    }
+
+    d1.type = INTEGER;
+    d1.u.val = query->id;
+    task(NULL, query->dbref, query_id, 2, &d1, &d2);
+    data_discard(&d2);
+
+    string_discard(query->result);
+    free(query);
+}
+
 /* Write out everything in connections' write buffers.  Called by main()
  * before exiting; does not modify the write buffers to reflect writing. */
 void flush_output(void)
@@ -6,7 +6,9 @@
 typedef struct connection Connection;
 typedef struct server Server;
 typedef struct pending Pending;
+typedef struct query Query;
 
+#include <sys/types.h>
 #include "cmstring.h"
 #include "data.h"
 
@@ -14,6 +16,7 @@ struct connection {
     int fd;			/* File descriptor for input and output. */
     Buffer *write_buf;		/* Buffer for network output. */
     Dbref dbref;		/* The player, usually. */
+    int waiting_tasks;		/* Its tasks on the run queue. */
     struct {
 	char readable;		/* Connection has new data pending. */
 	char writable;		/* Connection can be written to. */
@@ -42,6 +45,19 @@ struct pending {
     Pending *next;
 };
 
+struct query {
+    int fd;			/* Pipe from the query process. */
+    pid_t pid;
+    long id;
+    Dbref dbref;		/* Who gets the result. */
+    String *result;		/* Literal text of the result, so far. */
+    int status;			/* The process's exit status. */
+    time_t started;
+    int readable;
+    int finished;
+    Query *next;
+};
+
 void flush_defunct(void);
 void handle_io_events(long sec);
 void tell(long dbref, Buffer *buf);
@@ -49,6 +65,11 @@ int boot(long dbref);
 int add_server(int port, long dbref);
 int remove_server(int port);
 long make_connection(char *addr, int port, Dbref receiver);
+long make_query(Dbref dbref, Ident message, List *args, Dbref receiver);
+int cancel_query(long id);
+void cancel_queries(void);
+void expire_queries(void);
+int queries_next_timeout(void);
 void flush_output(void);
 
 #endif
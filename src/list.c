@@ -29,6 +29,7 @@ List *list_new(int len)
     while (size < len)
 	size = size * 2 + MALLOC_DELTA;
     new = emalloc(sizeof(List) + (size * sizeof(Data)));
+    new->start = 0;
     new->len = 0;
     new->size = size;
     new->refs = 1;
@@ -58,7 +59,7 @@ Data *list_next(List *list, Data *d)
 
 Data *list_last(List *list)
 {
-    return list->el + list->start + list->len - 1;
+    return (list->len != 0) ? list->el + list->start + list->len - 1 : NULL;
 }
 
 Data *list_prev(List *list, Data *d)
@@ -200,7 +201,7 @@ List *list_reverse(List *list)
 
 List *list_setadd(List *list, Data *d)
 {
-    if (list_search(list, d) == -1)
+    if (list_search(list, d) != -1)
 	return list;
     return list_add(list, d);
 }
@@ -13,6 +13,7 @@
 #include "log.h"
 #include "ident.h"
 #include "util.h"
+#include "memory.h"
 
 #ifdef S_IRUSR
 #define READ_WRITE		(S_IRUSR | S_IWUSR)
@@ -23,6 +24,9 @@
 #endif
 
 #define NAME_CACHE_SIZE 503
+#define CHANGE_TAB_SIZE 509
+
+typedef struct change Change;
 
 static datum dbref_key(long dbref, Number_buf nbuf);
 static datum name_key(long name);
@@ -32,9 +36,27 @@ static datum dbref_value(long dbref, Number_buf nbuf);
 static void sync_name_cache(void);
 static int store_name(long name, long dbref);
 static int get_name(long name, long *dbref);
+static datum index_fetch(datum key);
+static int index_store(datum key, datum value);
+static int index_delete(datum key);
+static Change *find_change(datum key);
+static void add_change(datum key, datum value);
+static unsigned long hash_key(datum key);
 
 static DBM *dbp;
 
+/* While the index is frozen, changes to it wait here instead of going to the
+ * dbm file, so that query processes reading the file see it as it was when
+ * they started.  A change with a NULL value.dptr deletes the key. */
+struct change {
+    datum key;
+    datum value;
+    Change *next;
+};
+
+static Change *changes[CHANGE_TAB_SIZE];
+static int frozen;
+
 struct name_cache_entry {
     long name;
     long dbref;
@@ -73,6 +95,50 @@ void lookup_sync(void)
 	panic("Cannot reopen dbm database file.");
 }
 
+/* Modifies:	The index.
+ * Effects:	Writes the index to disk and freezes it, so that it doesn't
+ *		change on disk until lookup_thaw(). */
+void lookup_freeze(void)
+{
+    lookup_sync();
+    frozen = 1;
+}
+
+/* Modifies:	The index.
+ * Effects:	Writes the changes made since lookup_freeze() to disk. */
+void lookup_thaw(void)
+{
+    Change *change, *next;
+    int i;
+
+    for (i = 0; i < CHANGE_TAB_SIZE; i++) {
+	for (change = changes[i]; change; change = next) {
+	    next = change->next;
+	    if (change->value.dptr) {
+		if (dbm_store(dbp, change->key, change->value, DBM_REPLACE))
+		    write_log("ERROR: Failed to store a frozen key.");
+		free(change->value.dptr);
+	    } else {
+		dbm_delete(dbp, change->key);
+	    }
+	    free(change->key.dptr);
+	    free(change);
+	}
+	changes[i] = NULL;
+    }
+    frozen = 0;
+}
+
+/* Requires:	The index is frozen, and we are in a query process.
+ * Effects:	Opens the index again read-only, leaving the server's handle
+ *		alone.  The index stays frozen for good. */
+void lookup_snapshot(void)
+{
+    dbp = dbm_open("binary/index", O_RDONLY, READ_WRITE);
+    if (!dbp)
+	panic("Cannot reopen dbm database file.");
+}
+
 int lookup_retrieve_dbref(long dbref, off_t *offset, int *size)
 {
     datum key, value;
@@ -80,7 +146,7 @@ int lookup_retrieve_dbref(long dbref, off_t *offset, int *size)
 
     /* Get the value for dbref from the database. */
     key = dbref_key(dbref, nbuf);
-    value = dbm_fetch(dbp, key);
+    value = index_fetch(key);
     if (!value.dptr)
 	return 0;
 
@@ -95,7 +161,7 @@ int lookup_store_dbref(long dbref, off_t offset, int size)
 
     key = dbref_key(dbref, nbuf1);
     value = offset_size_value(offset, size, nbuf2);
-    if (dbm_store(dbp, key, value, DBM_REPLACE)) {
+    if (index_store(key, value)) {
 	write_log("ERROR: Failed to store key %l.", dbref);
 	return 0;
     }
@@ -110,7 +176,7 @@ int lookup_remove_dbref(long dbref)
 
     /* Remove the key from the database. */
     key = dbref_key(dbref, nbuf);
-    if (dbm_delete(dbp, key)) {
+    if (index_delete(key)) {
 	write_log("ERROR: Failed to delete key %l.", dbref);
 	return 0;
     }
@@ -216,7 +282,7 @@ int lookup_remove_name(long name)
 
     /* Remove the key from the database. */
     key = name_key(name);
-    if (dbm_delete(dbp, key))
+    if (index_delete(key))
 	return 0;
     return 1;
 }
@@ -330,7 +396,7 @@ static int store_name(long name, long dbref)
     value = dbref_value(dbref, nbuf);
 
     key = name_key(name);
-    if (dbm_store(dbp, key, value, DBM_REPLACE)) {
+    if (index_store(key, value)) {
 	write_log("ERROR: Failed to store key %s.", name);
 	return 0;
     }
@@ -344,7 +410,7 @@ static int get_name(long name, long *dbref)
 
     /* Get the key from the database. */
     key = name_key(name);
-    value = dbm_fetch(dbp, key);
+    value = index_fetch(key);
     if (!value.dptr)
 	return 0;
 
@@ -352,3 +418,89 @@ static int get_name(long name, long *dbref)
     return 1;
 }
 
+static datum index_fetch(datum key)
+{
+    Change *change;
+
+    if (frozen) {
+	change = find_change(key);
+	if (change)
+	    return change->value;
+    }
+    return dbm_fetch(dbp, key);
+}
+
+static int index_store(datum key, datum value)
+{
+    if (!frozen)
+	return dbm_store(dbp, key, value, DBM_REPLACE);
+    add_change(key, value);
+    return 0;
+}
+
+static int index_delete(datum key)
+{
+    datum value;
+
+    if (!frozen)
+	return dbm_delete(dbp, key);
+
+    /* Fail if the key isn't there, as dbm_delete() would. */
+    if (!index_fetch(key).dptr)
+	return -1;
+    value.dptr = NULL;
+    value.dsize = 0;
+    add_change(key, value);
+    return 0;
+}
+
+static Change *find_change(datum key)
+{
+    Change *change;
+
+    change = changes[hash_key(key) % CHANGE_TAB_SIZE];
+    for (; change; change = change->next) {
+	if (change->key.dsize == key.dsize &&
+	    MEMCMP(change->key.dptr, key.dptr, key.dsize) == 0)
+	    return change;
+    }
+    return NULL;
+}
+
+static void add_change(datum key, datum value)
+{
+    Change *change;
+    int ind;
+
+    change = find_change(key);
+    if (change) {
+	if (change->value.dptr)
+	    free(change->value.dptr);
+    } else {
+	ind = hash_key(key) % CHANGE_TAB_SIZE;
+	change = EMALLOC(Change, 1);
+	change->key.dptr = EMALLOC(char, key.dsize);
+	MEMCPY(change->key.dptr, key.dptr, key.dsize);
+	change->key.dsize = key.dsize;
+	change->next = changes[ind];
+	changes[ind] = change;
+    }
+
+    change->value.dsize = value.dsize;
+    if (value.dptr) {
+	change->value.dptr = EMALLOC(char, value.dsize);
+	MEMCPY(change->value.dptr, value.dptr, value.dsize);
+    } else {
+	change->value.dptr = NULL;
+    }
+}
+
+static unsigned long hash_key(datum key)
+{
+    unsigned long hashval = 0;
+    int i;
+
+    for (i = 0; i < key.dsize; i++)
+	hashval = hashval * 31 + (unsigned char) key.dptr[i];
+    return hashval;
+}
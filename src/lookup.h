@@ -6,6 +6,9 @@
 void lookup_open(char *name, int new);
 void lookup_close(void);
 void lookup_sync(void);
+void lookup_freeze(void);
+void lookup_thaw(void);
+void lookup_snapshot(void);
 int lookup_retrieve_dbref(long dbref, off_t *offset, int *size);
 int lookup_store_dbref(long dbref, off_t offset, int size);
 int lookup_remove_dbref(long dbref);
@@ -39,8 +39,9 @@ int main(int argc, char **argv)
     initialize(argc, argv);
     main_loop();
 
-    /* We get this far after a C-- shutdown().  Sync the cache, flush output
-     * buffers, and exit normally. */
+    /* We get this far after a C-- shutdown().  Kill queries, sync the cache,
+     * flush output buffers, and exit normally. */
+    cancel_queries();
     cache_sync();
     db_close();
     flush_output();
@@ -144,17 +145,28 @@ static void initialize(int argc, char **argv)
 
 static void main_loop(void)
 {
-    int seconds;
+    int seconds, wait;
     time_t next_heartbeat = 0, t;
 
     while (running) {
+	/* Kill queries which have run too long.  Their receivers get ~query
+	 * below. */
+	expire_queries();
+
 	/* Delete any defunct connection or server records.  This sends a
 	 * "disconnect"* message to the system object for each connection done
-	 * away with. */
+	 * away with, and the results of finished queries. */
 	flush_defunct();
 
-	/* Sanity check: make sure there are no objects in active chains. */
-	cache_sanity_check();
+	/* One of those tasks may have called shutdown(). */
+	if (!running)
+	    break;
+
+	/* Sanity check: make sure there are no objects in active chains.
+	 * Tasks which haven't finished hold on to objects, so we can only
+	 * check when there are none. */
+	if (!tasks_pending())
+	    cache_sanity_check();
 
 	/* Find number of seconds before next heartbeat. */
 	if (heartbeat_freq == -1) {
@@ -167,8 +179,18 @@ static void main_loop(void)
 	    seconds = (t >= next_heartbeat) ? 0 : next_heartbeat - t;
 	}
 
-	/* Handle any I/O events waiting. */
-	handle_io_events(seconds);
+	/* Don't wait past the start time of the next forked task, or the time
+	 * the next query runs out. */
+	wait = tasks_next_wake();
+	if (wait != -1 && (seconds == -1 || wait < seconds))
+	    seconds = wait;
+	wait = queries_next_timeout();
+	if (wait != -1 && (seconds == -1 || wait < seconds))
+	    seconds = wait;
+
+	/* Handle any I/O events waiting.  Don't wait for them if there are
+	 * tasks ready to run. */
+	handle_io_events(tasks_runnable() ? 0 : seconds);
 
 	if (heartbeat_freq != -1) {
 	    time(&t);
@@ -177,6 +199,11 @@ static void main_loop(void)
 		task(NULL, SYSTEM_DBREF, heartbeat_id, 0);
 	    }
 	}
+
+	/* Give each task that is ready to run a time slice, including forked
+	 * tasks whose start time has come. */
+	wake_tasks();
+	run_tasks();
     }
 }
 
@@ -52,3 +52,20 @@ void op_task_id(void)
     push_int(task_id);
 }
 
+
+void op_suspend(void)
+{
+    /* Accept no arguments, and stop the task until resume() names it.  The
+     * result is the value given to resume(), or 0; push 0 for it to replace,
+     * and suspend the task last, since the frame is put away.  Other tasks
+     * run while this one is suspended, so refuse inside an atomic
+     * statement. */
+    if (!func_init_0())
+	return;
+    if (task_atomic()) {
+	throw(perm_id, "Cannot suspend inside an atomic statement.");
+	return;
+    }
+    push_int(0);
+    task_suspend();
+}
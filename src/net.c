@@ -70,12 +70,13 @@ int get_server_socket(int port)
  * returning, or -1 if we can wait forever.  Returns nonzero if an I/O event
  * happened. */
 int io_event_wait(long sec, Connection *connections, Server *servers,
-		  Pending *pendings)
+		  Pending *pendings, Query *queries)
 {
     struct timeval tv, *tvp;
     Connection *conn;
     Server *serv;
     Pending *pend;
+    Query *query;
     fd_set read_fds, write_fds;
     int flags, nfds, count, result, error, dummy = sizeof(int);
 
@@ -94,9 +95,11 @@ int io_event_wait(long sec, Connection *connections, Server *servers,
     nfds = 0;
 
     /* Listen for new data on connections, and also check for ability to write
-     * to them if we have data to write. */
+     * to them if we have data to write.  A connection with a task waiting for
+     * a time slice gets no new input until the task finishes, so that its
+     * commands run one at a time. */
     for (conn = connections; conn; conn = conn->next) {
-	if (!conn->flags.dead)
+	if (!conn->flags.dead && !conn->waiting_tasks)
 	    FD_SET(conn->fd, &read_fds);
 	if (conn->write_buf->len)
 	    FD_SET(conn->fd, &write_fds);
@@ -123,6 +126,15 @@ int io_event_wait(long sec, Connection *connections, Server *servers,
 	}
     }
 
+    /* Listen for results from query processes. */
+    for (query = queries; query; query = query->next) {
+	if (!query->finished) {
+	    FD_SET(query->fd, &read_fds);
+	    if (query->fd >= nfds)
+		nfds = query->fd + 1;
+	}
+    }
+
     /* Call select(). */
     count = select(nfds, &read_fds, &write_fds, NULL, tvp);
 
@@ -181,6 +193,12 @@ int io_event_wait(long sec, Connection *connections, Server *servers,
 	}
     }
 
+    /* Check if any query processes have sent more of their results. */
+    for (query = queries; query; query = query->next) {
+	if (!query->finished && FD_ISSET(query->fd, &read_fds))
+	    query->readable = 1;
+    }
+
     /* Return nonzero, indicating that at least one I/O event occurred. */
     return 1;
 }
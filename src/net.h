@@ -6,7 +6,7 @@
 
 int get_server_socket(int port);
 int io_event_wait(long sec, Connection *connections, Server *servers,
-		  Pending *pendings);
+		  Pending *pendings, Query *queries);
 long non_blocking_connect(char *addr, int port, int *socket_return);
 
 extern long server_failure_reason;
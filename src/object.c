@@ -16,6 +16,7 @@
 #include "decode.h"
 #include "util.h"
 #include "log.h"
+#include "config.h"
 
 /* We use MALLOC_DELTA to keep table sizes to 32 bytes less than a power of
  * two, if pointers and longs are four bytes. */
@@ -27,16 +28,6 @@
 #define IDENTS_STARTING_SIZE	(16 - MALLOC_DELTA)
 #define METHOD_CACHE_SIZE	503
 
-/* Data for method searches. */
-typedef struct search_params Search_params;
-
-struct search_params {
-    unsigned long name;
-    long stop_at;
-    int done;
-    Method *last_method_found;
-};
-
 struct {
     long stamp;
     Dbref dbref;
@@ -45,17 +36,30 @@ struct {
     Dbref loc;
 } method_cache[METHOD_CACHE_SIZE];
 
+static Object *object_alloc(long dbref, List *parents);
 static void object_update_parents(Object *object,
-				  List *(*list_op)(List *, Data *));
-static List *object_ancestors_aux(long dbref, List *ancestors);
-static int object_has_ancestor_aux(long dbref, long ancestor);
+				  void (*child_op)(Object *, long));
+static void children_insert(Object *object, long dbref);
+static List *object_linearize(long dbref);
+static struct ancestry *ancestry_entry(long dbref);
+static int ancestry_cached(long dbref);
+static struct ancestry *ancestry_check(long dbref);
+static void ancestry_set(long dbref, List *parents);
 static Var *object_create_var(Object *object, long class, long name);
 static Var *object_find_var(Object *object, long class, long name);
+static Var *object_find_var_slot(Object *object, long class, long name,
+				 int *slot);
 static Method *object_find_method_local(Object *object, long name);
 static Method *method_cache_check(long dbref, long name, long after);
 static void method_cache_set(long dbref, long name, long after, long loc);
-static void search_object(long dbref, Search_params *params);
+static int method_cache_valid(long stamp, long dbref);
+static int ancestors_valid(long stamp, long dbref);
+static void method_cache_invalidate(Object *object, int parents_changed);
+static void method_version_bump(long dbref, int parents_changed);
+static Method *search_ancestors(long dbref, long name, long after);
 static void method_delete_code_refs(Method *method);
+static int instr_len(Method *method, int pos);
+static void method_mark_ticks(Method *method);
 static void object_text_dump_aux(Object *obj, FILE *fp);
 
 /* Count for keeping track of of already-searched objects during searches. */
@@ -64,13 +68,94 @@ long cur_search;
 /* Keeps track of dbref for next object in database. */
 long db_top;
 
-/* Validity count for method cache (incrementing this count invalidates all
- * cache entries. */
-static int cur_stamp = 1;
+/* Cached method lookups are stamped with the value of method_clock when they
+ * are made.  When an object's methods or parents change, we bump its method
+ * version, and when its parents change, its parents version too; we don't
+ * touch its descendants.  A lookup for a dbref is good if its stamp is no
+ * older than the method versions of all of dbref's ancestors, and an
+ * ancestors list is good if its stamp is no older than the parents versions
+ * of all the ancestors in it. */
+static long method_clock = 1;
+static struct method_version {
+    long methods;
+    long parents;
+} *method_versions = NULL;
+static long method_versions_size = 0;
+
+/* Linearized ancestors lists, indexed by dbref, with hash sets of the
+ * ancestors in each list for has_ancestor() checks.  We keep these outside of
+ * the objects so that we can answer those checks without retrieving objects
+ * from the cache.  They are not saved to disk.  Each entry also remembers the
+ * newest method and parents versions among its ancestors, as of the value of
+ * method_clock in checked, so that until something changes, checking a
+ * stamp against them doesn't mean walking the list. */
+static struct ancestry {
+    long stamp;
+    List *ancestors;
+    Dbref *set;
+    int set_size;
+    long checked;
+    long methods;
+    long parents;
+} *ancestry_tab = NULL;
+static long ancestry_tab_size = 0;
+
+/* Method cache statistics, reported by method_cache_stats(). */
+long method_cache_hits, method_cache_misses;
+long method_cache_invalidations, ancestry_rebuilds;
 
 /* Error-checking on parents is the job of the calling function.  Also, dire
  * things may happen if an object numbered dbref already exists. */
 Object *object_new(long dbref, List *parents)
+{
+    Object *new;
+
+    new = object_alloc(dbref, parents);
+
+    /* Add this object to the children list of parents. */
+    object_update_parents(new, object_add_child);
+
+    return new;
+}
+
+/* Create n new objects with the given parents, and return a list of their
+ * dbrefs.  This is like calling object_new(-1, parents) n times, but we only
+ * retrieve each parent once.  The same error-checking caveat applies. */
+List *object_new_many(List *parents, int n)
+{
+    Object **ps, *new;
+    List *dbrefs;
+    Data *d;
+    int num_parents, i, j;
+
+    /* Hold onto the parents while we add children to them. */
+    num_parents = list_length(parents);
+    ps = TMALLOC(Object *, num_parents);
+    for (i = 0; i < num_parents; i++)
+	ps[i] = cache_retrieve(list_elem(parents, i)->u.dbref);
+
+    dbrefs = list_new(n);
+    d = list_empty_spaces(dbrefs, n);
+    for (i = 0; i < n; i++) {
+	new = object_alloc(-1, parents);
+	for (j = 0; j < num_parents; j++)
+	    object_add_child(ps[j], new->dbref);
+	d[i].type = DBREF;
+	d[i].u.dbref = new->dbref;
+	cache_discard(new);
+    }
+
+    for (i = 0; i < num_parents; i++) {
+	ps[i]->dirty = 1;
+	cache_discard(ps[i]);
+    }
+    TFREE(ps, num_parents);
+
+    return dbrefs;
+}
+
+/* Allocate and initialize a new object, without telling its parents. */
+static Object *object_alloc(long dbref, List *parents)
 {
     Object *new;
     int i;
@@ -82,7 +167,15 @@ Object *object_new(long dbref, List *parents)
 
     new = cache_get_holder(dbref);
     new->parents = list_dup(parents);
-    new->children = list_new(0);
+
+    /* Don't allocate a children table until we need it. */
+    new->children.tab = NULL;
+    new->children.hashtab = NULL;
+    new->children.blanks = -1;
+    new->children.first = new->children.last = -1;
+    new->children.num = 0;
+    new->children.size = 0;
+    new->children.list = NULL;
 
     /* Initialize variables table and hash table. */
     new->vars.tab = EMALLOC(Var, VAR_STARTING_SIZE);
@@ -120,8 +213,8 @@ Object *object_new(long dbref, List *parents)
 
     new->search = 0;
 
-    /* Add this object to the children list of parents. */
-    object_update_parents(new, list_add);
+    /* The object isn't on disk yet. */
+    new->dirty = 1;
 
     return new;
 }
@@ -134,9 +227,14 @@ void object_free(Object *object)
 {
     int i;
 
-    /* Free parents and children list. */
+    /* Free parents list and children table. */
     list_discard(object->parents);
-    list_discard(object->children);
+    if (object->children.size) {
+	free(object->children.tab);
+	free(object->children.hashtab);
+    }
+    if (object->children.list)
+	list_discard(object->children.list);
 
     /* Free variable names and contents. */
     for (i = 0; i < object->vars.size; i++) {
@@ -176,30 +274,32 @@ void object_free(Object *object)
  * the structure it came in, which belongs to the cache. */
 void object_destroy(Object *object)
 {
-    List *children;
-    Data *d, this;
+    Data this;
     Object *kid;
+    int i;
 
-    /* Invalidate the method cache. */
-    cur_stamp++;
+    /* Invalidate cached lookups for this object and its descendants. */
+    method_cache_invalidate(object, 1);
 
     /* Tell parents we don't exist any more. */
-    object_update_parents(object, list_delete_element);
+    object_update_parents(object, object_del_child);
 
     /* Tell children the same thing (no function for this, just do it).
      * Also, check if any kid hits zero parents, and reparent it to our
-     * parents if it does. */
-    children = object->children;
-
+     * parents if it does.  The kids' new ancestors lists won't include us,
+     * so bumping our version doesn't reach their cached lookups; bump
+     * theirs. */
     this.type = DBREF;
     this.u.dbref = object->dbref;
-    for (d = list_first(children); d; d = list_next(children, d)) {
-	kid = cache_retrieve(d->u.dbref);
+    for (i = object->children.first; i != -1;
+	 i = object->children.tab[i].next_added) {
+	kid = cache_retrieve(object->children.tab[i].dbref);
+	method_cache_invalidate(kid, 1);
 	kid->parents = list_delete_element(kid->parents, &this);
 	if (!kid->parents->len) {
 	    list_discard(kid->parents);
 	    kid->parents = list_dup(object->parents);
-	    object_update_parents(kid, list_add);
+	    object_update_parents(kid, object_add_child);
 	}
 	kid->dirty = 1;
 	cache_discard(kid);
@@ -214,107 +314,343 @@ void object_destroy(Object *object)
 }
 
 static void object_update_parents(Object *object,
-				  List *(*list_op)(List *, Data *))
+				  void (*child_op)(Object *, long))
 {
     Object *p;
     List *parents;
-    Data *d, this;
-
-    /* Make a data structure for the children list. */
-    this.type = DBREF;
-    this.u.dbref = object->dbref;
+    Data *d;
 
     parents = object->parents;
 
     for (d = list_first(parents); d; d = list_next(parents, d)) {
 	p = cache_retrieve(d->u.dbref);
-	p->children = (*list_op)(p->children, &this);
+	(*child_op)(p, object->dbref);
 	p->dirty = 1;
 	cache_discard(p);
     }
 }
 
-List *object_ancestors(long dbref)
+/* Returns a list of the object's children in the order they were added. */
+List *object_children(Object *object)
 {
-    List *ancestors;
+    Data *d;
+    int i;
 
-    /* Get the ancestor list, backwards. */
-    ancestors = list_new(0);
-    cur_search++;
-    ancestors = object_ancestors_aux(dbref, ancestors);
+    if (!object->children.list) {
+	object->children.list = list_new(object->children.num);
+	d = list_empty_spaces(object->children.list, object->children.num);
+	for (i = object->children.first; i != -1;
+	     i = object->children.tab[i].next_added) {
+	    d->type = DBREF;
+	    d->u.dbref = object->children.tab[i].dbref;
+	    d++;
+	}
+    }
 
-    return list_reverse(ancestors);
+    return list_dup(object->children.list);
 }
 
-/* Modifies ancestors.  Returns a backwards list. */
-static List *object_ancestors_aux(long dbref, List *ancestors)
+void object_add_child(Object *object, long dbref)
 {
-    Object *object;
-    List *parents;
-    Data *d, this;
+    struct child *old_tab;
+    int *old_hashtab, old_size, old_first, i;
 
-    object = cache_retrieve(dbref);
-    if (object->search == cur_search) {
-	cache_discard(object);
-	return ancestors;
+    if (object->children.list) {
+	list_discard(object->children.list);
+	object->children.list = NULL;
     }
-    object->dirty = 1;
-    object->search = cur_search;
 
-    parents = list_dup(object->parents);
-    cache_discard(object);
+    if (object->children.blanks == -1) {
+	/* Grow the table, and insert the old children in order. */
+	old_tab = object->children.tab;
+	old_hashtab = object->children.hashtab;
+	old_size = object->children.size;
+	old_first = object->children.first;
+
+	object->children.size = old_size * 2 + MALLOC_DELTA;
+	object->children.tab = EMALLOC(struct child, object->children.size);
+	object->children.hashtab = EMALLOC(int, object->children.size);
+	for (i = 0; i < object->children.size; i++) {
+	    object->children.hashtab[i] = -1;
+	    object->children.tab[i].dbref = -1;
+	    object->children.tab[i].next = i + 1;
+	}
+	object->children.tab[object->children.size - 1].next = -1;
+	object->children.blanks = 0;
+	object->children.first = object->children.last = -1;
+	object->children.num = 0;
+
+	for (i = old_first; i != -1; i = old_tab[i].next_added)
+	    children_insert(object, old_tab[i].dbref);
+	if (old_size) {
+	    free(old_tab);
+	    free(old_hashtab);
+	}
+    }
 
-    for (d = list_last(parents); d; d = list_prev(parents, d))
-	ancestors = object_ancestors_aux(d->u.dbref, ancestors);
-    list_discard(parents);
+    children_insert(object, dbref);
+}
 
-    this.type = DBREF;
-    this.u.dbref = dbref;
-    return list_add(ancestors, &this);
+/* There must be a blank in the children table. */
+static void children_insert(Object *object, long dbref)
+{
+    struct child *tab = object->children.tab;
+    int ind, hval;
+
+    ind = object->children.blanks;
+    object->children.blanks = tab[ind].next;
+
+    tab[ind].dbref = dbref;
+    hval = dbref % object->children.size;
+    tab[ind].next = object->children.hashtab[hval];
+    object->children.hashtab[hval] = ind;
+
+    tab[ind].prev_added = object->children.last;
+    tab[ind].next_added = -1;
+    if (object->children.last != -1)
+	tab[object->children.last].next_added = ind;
+    else
+	object->children.first = ind;
+    object->children.last = ind;
+
+    object->children.num++;
 }
 
-int object_has_ancestor(long dbref, long ancestor)
+void object_del_child(Object *object, long dbref)
 {
-    if (dbref == ancestor)
-	return 1;
-    cur_search++;
-    return object_has_ancestor_aux(dbref, ancestor);
+    struct child *tab = object->children.tab;
+    int *indp, ind;
+
+    if (!object->children.size)
+	return;
+
+    /* Find the hash thread link which points to the child. */
+    indp = &object->children.hashtab[dbref % object->children.size];
+    for (; *indp != -1; indp = &tab[*indp].next) {
+	if (tab[*indp].dbref == dbref)
+	    break;
+    }
+    if (*indp == -1)
+	return;
+
+    /* Unlink the child from the hash thread and the order thread, and add
+     * its entry to the blanks thread. */
+    ind = *indp;
+    *indp = tab[ind].next;
+    if (tab[ind].prev_added != -1)
+	tab[tab[ind].prev_added].next_added = tab[ind].next_added;
+    else
+	object->children.first = tab[ind].next_added;
+    if (tab[ind].next_added != -1)
+	tab[tab[ind].next_added].prev_added = tab[ind].prev_added;
+    else
+	object->children.last = tab[ind].prev_added;
+    tab[ind].dbref = -1;
+    tab[ind].next = object->children.blanks;
+    object->children.blanks = ind;
+    object->children.num--;
+
+    if (object->children.list) {
+	list_discard(object->children.list);
+	object->children.list = NULL;
+    }
 }
 
-static int object_has_ancestor_aux(long dbref, long ancestor)
+List *object_ancestors(long dbref)
+{
+    /* The linearized ancestor list has ancestors before descendants; we want
+     * the object first. */
+    return list_reverse(object_linearize(dbref));
+}
+
+/* Returns a list of dbref and its ancestors in reverse depth-first order with
+ * no repeats, searching parents right-to-left.  Ancestors come before their
+ * descendants, so dbref is always last.  We cache the list in the ancestry
+ * table until dbref's ancestry changes. */
+static List *object_linearize(long dbref)
 {
     Object *object;
     List *parents;
+    Dbref *work, top;
     Data *d;
+    int work_pos, work_size, pushed;
+
+    if (!ancestry_cached(dbref)) {
+	/* Each object's list is made from its parents' lists, so walk up the
+	 * hierarchy with a stack of objects whose lists we need, and make an
+	 * object's list once all of its parents have theirs.  There are no
+	 * cycles, so this finishes. */
+	work_size = 16;
+	work = EMALLOC(Dbref, work_size);
+	work[0] = dbref;
+	work_pos = 1;
+	while (work_pos) {
+	    top = work[work_pos - 1];
+	    if (ancestry_cached(top)) {
+		work_pos--;
+		continue;
+	    }
 
-    object = cache_retrieve(dbref);
-
-    /* Don't search an object twice. */
-    if (object->search == cur_search) {
-	cache_discard(object);
-	return 0;
-    }
-    object->dirty = 1;
-    object->search = cur_search;
+	    object = cache_retrieve(top);
+	    parents = list_dup(object->parents);
+	    cache_discard(object);
 
-    parents = list_dup(object->parents);
-    cache_discard(object);
+	    pushed = 0;
+	    for (d = list_first(parents); d; d = list_next(parents, d)) {
+		if (ancestry_cached(d->u.dbref))
+		    continue;
+		if (work_pos == work_size) {
+		    work_size = work_size * 2 + MALLOC_DELTA;
+		    work = EREALLOC(work, Dbref, work_size);
+		}
+		work[work_pos++] = d->u.dbref;
+		pushed = 1;
+	    }
 
-    for (d = list_first(parents); d; d = list_next(parents, d)) {
-	if (d->u.dbref == ancestor) {
+	    if (!pushed) {
+		ancestry_set(top, parents);
+		work_pos--;
+	    }
 	    list_discard(parents);
-	    return 1;
 	}
+	free(work);
     }
 
-    for (d = list_first(parents); d; d = list_next(parents, d)) {
-	if (object_has_ancestor_aux(d->u.dbref, ancestor)) {
-	    list_discard(parents);
-	    return 1;
+    return list_dup(ancestry_entry(dbref)->ancestors);
+}
+
+/* Returns true if dbref's ancestors list is cached and still good. */
+static int ancestry_cached(long dbref)
+{
+    struct ancestry *entry;
+
+    entry = ancestry_check(dbref);
+    return entry->ancestors && ancestors_valid(entry->stamp, dbref);
+}
+
+/* Returns the ancestry table entry for dbref, with the newest versions among
+ * the ancestors in its list brought up to date.  The pointer is good until
+ * the next call. */
+static struct ancestry *ancestry_check(long dbref)
+{
+    struct ancestry *entry;
+    struct method_version *version;
+    Data *d;
+
+    entry = ancestry_entry(dbref);
+    if (!entry->ancestors || entry->checked == method_clock)
+	return entry;
+
+    entry->methods = entry->parents = 0;
+    for (d = list_first(entry->ancestors); d;
+	 d = list_next(entry->ancestors, d)) {
+	if (d->u.dbref >= method_versions_size)
+	    continue;
+	version = &method_versions[d->u.dbref];
+	if (version->methods > entry->methods)
+	    entry->methods = version->methods;
+	if (version->parents > entry->parents)
+	    entry->parents = version->parents;
+    }
+    entry->checked = method_clock;
+    return entry;
+}
+
+/* Makes and caches the ancestors list for dbref, given its parents, all of
+ * whose lists must be cached. */
+static void ancestry_set(long dbref, List *parents)
+{
+    struct ancestry *entry;
+    List *ancestors, *parent_ancestors;
+    Data *d, *a, this;
+    int i, j;
+
+    /* Merge the parents' ancestor lists, right to left.  An ancestor already
+     * in the list had its own ancestors added before it, so skipping it
+     * gives the same order as a depth-first search which doesn't visit any
+     * object twice. */
+    d = list_last(parents);
+    if (d) {
+	ancestors = list_dup(ancestry_entry(d->u.dbref)->ancestors);
+	for (d = list_prev(parents, d); d; d = list_prev(parents, d)) {
+	    parent_ancestors = ancestry_entry(d->u.dbref)->ancestors;
+	    for (a = list_first(parent_ancestors); a;
+		 a = list_next(parent_ancestors, a))
+		ancestors = list_setadd(ancestors, a);
 	}
+    } else {
+	ancestors = list_new(1);
     }
 
-    list_discard(parents);
+    this.type = DBREF;
+    this.u.dbref = dbref;
+    ancestors = list_add(ancestors, &this);
+
+    /* Remember the list, and hash its dbrefs into a set twice its size,
+     * resolving collisions by linear probing. */
+    entry = ancestry_entry(dbref);
+    if (entry->ancestors) {
+	list_discard(entry->ancestors);
+	free(entry->set);
+    }
+    ancestry_rebuilds++;
+    entry->stamp = method_clock;
+    entry->checked = 0;
+    entry->ancestors = ancestors;
+    entry->set_size = list_length(ancestors) * 2 + 1;
+    entry->set = EMALLOC(Dbref, entry->set_size);
+    for (i = 0; i < entry->set_size; i++)
+	entry->set[i] = -1;
+    for (d = list_first(ancestors); d; d = list_next(ancestors, d)) {
+	j = d->u.dbref % entry->set_size;
+	while (entry->set[j] != -1)
+	    j = (j + 1) % entry->set_size;
+	entry->set[j] = d->u.dbref;
+    }
+}
+
+/* Returns the ancestry table entry for dbref, which may hold a stale list.
+ * The pointer is good until the next call. */
+static struct ancestry *ancestry_entry(long dbref)
+{
+    long new_size, i;
+
+    if (dbref >= ancestry_tab_size) {
+	new_size = ancestry_tab_size * 2 + MALLOC_DELTA;
+	if (new_size <= dbref)
+	    new_size = dbref + MALLOC_DELTA;
+	ancestry_tab = EREALLOC(ancestry_tab, struct ancestry, new_size);
+	for (i = ancestry_tab_size; i < new_size; i++)
+	    ancestry_tab[i].ancestors = NULL;
+	ancestry_tab_size = new_size;
+    }
+
+    return &ancestry_tab[dbref];
+}
+
+/* We only retrieve objects from the cache if dbref's ancestors list isn't
+ * cached. */
+int object_has_ancestor(long dbref, long ancestor)
+{
+    struct ancestry *entry;
+    int i;
+
+    if (dbref == ancestor)
+	return 1;
+    if (ancestor < 0)
+	return 0;
+
+    if (!ancestry_cached(dbref))
+	list_discard(object_linearize(dbref));
+    entry = ancestry_entry(dbref);
+
+    /* Look up ancestor in the hash set. */
+    i = ancestor % entry->set_size;
+    while (entry->set[i] != -1) {
+	if (entry->set[i] == ancestor)
+	    return 1;
+	i = (i + 1) % entry->set_size;
+    }
     return 0;
 }
 
@@ -334,18 +670,20 @@ int object_change_parents(Object *object, List *parents)
 	    return d - list_first(parents);
     }
 
-    /* Invalidate the method cache. */
-    cur_stamp++;
+    /* Invalidate cached lookups and ancestor lists for this object and its
+     * descendants. */
+    method_cache_invalidate(object, 1);
 
     /* Tell our old parents that we're no longer a kid, and discard the old
      * parents list. */
-    object_update_parents(object, list_delete_element);
+    object_update_parents(object, object_del_child);
     list_discard(object->parents);
 
     /* Set the object's parents list to a copy of the new list, and tell all
      * our new parents that we're a kid. */
     object->parents = list_dup(parents);
-    object_update_parents(object, list_add);
+    object->dirty = 1;
+    object_update_parents(object, object_add_child);
 
     /* Return -1, meaning that all the parents were okay. */
     return -1;
@@ -485,7 +823,7 @@ long object_del_param(Object *object, long name)
     /* This is the index-thread equivalent of double pointers in a standard
      * linked list.  We traverse the list using pointers to the ->next element
      * of the variables. */
-    indp = &object->vars.hashtab[hash(ident_name(name)) % object->vars.size];
+    indp = &object->vars.hashtab[ident_hash(name) % object->vars.size];
     for (; *indp != -1; indp = &object->vars.tab[*indp].next) {
 	var = &object->vars.tab[*indp];
 	if (var->name == name && var->class == object->dbref) {
@@ -507,34 +845,46 @@ long object_del_param(Object *object, long name)
     return paramnf_id;
 }
 
-long object_assign_var(Object *object, Object *class, long name, Data *val)
+/* If cache is not NULL, it holds hints about where to find the variable, and
+ * is updated to reflect where we found it. */
+long object_assign_var(Object *object, Object *class, long name, Data *val,
+		       Var_cache *cache)
 {
     Var *var;
 
     /* Make sure variable exists in class (method object). */
-    if (!object_find_var(class, class->dbref, name))
+    if (!object_find_var_slot(class, class->dbref, name,
+			      (cache) ? &cache->class_slot : NULL))
 	return paramnf_id;
 
     /* Get variable slot on object, creating it if necessary. */
-    var = object_find_var(object, class->dbref, name);
-    if (!var)
+    var = object_find_var_slot(object, class->dbref, name,
+			       (cache) ? &cache->slot : NULL);
+    if (!var) {
 	var = object_create_var(object, class->dbref, name);
+	if (cache)
+	    cache->slot = var - object->vars.tab;
+    }
 
     data_discard(&var->val);
     data_dup(&var->val, val);
+    object->dirty = 1;
 
     return NOT_AN_IDENT;
 }
 
-long object_retrieve_var(Object *object, Object *class, long name, Data *ret)
+long object_retrieve_var(Object *object, Object *class, long name, Data *ret,
+			 Var_cache *cache)
 {
     Var *var;
 
     /* Make sure variable exists on class. */
-    if (!object_find_var(class, class->dbref, name))
+    if (!object_find_var_slot(class, class->dbref, name,
+			      (cache) ? &cache->class_slot : NULL))
 	return paramnf_id;
 
-    var = object_find_var(object, class->dbref, name);
+    var = object_find_var_slot(object, class->dbref, name,
+			       (cache) ? &cache->slot : NULL);
     if (var) {
 	data_dup(ret, &var->val);
     } else {
@@ -578,7 +928,7 @@ static Var *object_create_var(Object *object, long class, long name)
 	for (i = 0; i < new_size; i++)
 	    object->vars.hashtab[i] = -1;
 	for (i = 0; i < object->vars.size; i++) {
-	    ind = hash(ident_name(object->vars.tab[i].name)) % new_size;
+	    ind = ident_hash(object->vars.tab[i].name) % new_size;
 	    object->vars.tab[i].next = object->vars.hashtab[ind];
 	    object->vars.hashtab[ind] = i;
 	}
@@ -605,7 +955,7 @@ static Var *object_create_var(Object *object, long class, long name)
     new->val.u.val = 0;
 
     /* Add variable to hash table thread. */
-    ind = hash(ident_name(name)) % object->vars.size;
+    ind = ident_hash(name) % object->vars.size;
     new->next = object->vars.hashtab[ind];
     object->vars.hashtab[ind] = new - object->vars.tab;
 
@@ -620,7 +970,7 @@ static Var *object_find_var(Object *object, long class, long name)
     Var *var;
 
     /* Traverse hash table thread, stopping if we get a match on the name. */
-    ind = object->vars.hashtab[hash(ident_name(name)) % object->vars.size];
+    ind = object->vars.hashtab[ident_hash(name) % object->vars.size];
     for (; ind != -1; ind = object->vars.tab[ind].next) {
 	var = &object->vars.tab[ind];
 	if (var->name == name && var->class == class)
@@ -630,58 +980,102 @@ static Var *object_find_var(Object *object, long class, long name)
     return NULL;
 }
 
+/* Look for a variable on an object, checking the table entry numbered by *slot
+ * before searching the hash table thread.  If we have to search, update *slot
+ * to point to the variable we find.  If slot is NULL, just search. */
+static Var *object_find_var_slot(Object *object, long class, long name,
+				 int *slot)
+{
+    Var *var;
+
+    if (!slot)
+	return object_find_var(object, class, name);
+
+    if (*slot >= 0 && *slot < object->vars.size) {
+	var = &object->vars.tab[*slot];
+	if (var->name == name && var->class == class)
+	    return var;
+    }
+
+    var = object_find_var(object, class, name);
+    if (var)
+	*slot = var - object->vars.tab;
+    return var;
+}
+
 /* Reference-counting kludge: on return, the method's object field has an extra
  * reference count, in order to keep it in cache.  dbref must be valid. */
 Method *object_find_method(long dbref, long name)
 {
-    Search_params params;
-    Object *object;
-    Method *method, *local_method;
-    List *parents;
-    Data *d;
+    Method *method;
 
     /* Look for cached value. */
     method = method_cache_check(dbref, name, -1);
     if (method)
 	return method;
 
-    object = cache_retrieve(dbref);
-    parents = list_dup(object->parents);
-    cache_discard(object);
+    method = search_ancestors(dbref, name, -1);
+    if (method)
+	method_cache_set(dbref, name, -1, method->object->dbref);
+    return method;
+}
 
-    /* If the object has only one parent, call this function recursively. */
-    if (list_length(parents) == 1) {
-	method = object_find_method(list_elem(parents, 0)->u.dbref, name);
-    } else {
-	/* We've hit a bulge; resort to the reverse depth-first search. */
-	cur_search++;
-	params.name = name;
-	params.stop_at = -1;
-	params.done = 0;
-	params.last_method_found = NULL;
-	for (d = list_last(parents); d; d = list_prev(parents, d))
-	    search_object(d->u.dbref, &params);
-	method = params.last_method_found;
+/* Like object_find_method(), but looks in cache first, and remembers where
+ * we found the method in cache afterwards.  The same reference-counting kludge
+ * applies. */
+Method *object_find_method_cached(long dbref, long name, Message_cache *cache)
+{
+    struct message_cache_entry *entry = NULL;
+    Object *object;
+    Method *method;
+    int i, slot;
+
+    /* Look for an entry for this receiver and message. */
+    for (i = 0; i < MESSAGE_CACHE_ENTRIES; i++) {
+	if (cache->entries[i].stamp && cache->entries[i].dbref == dbref &&
+	    cache->entries[i].name == name &&
+	    method_cache_valid(cache->entries[i].stamp, dbref)) {
+	    entry = &cache->entries[i];
+	    break;
+	}
     }
 
-    list_discard(parents);
-
-    if (!method || method->overridable) {
-	/* We didn't find a non-overridable method; check for a method on the
-	 * current object. */
-	object = cache_retrieve(dbref);
-	local_method = object_find_method_local(object, name);
-	if (local_method) {
-	    if (method)
-		cache_discard(method->object);
-	    method = local_method;
-	} else {
-	    cache_discard(object);
+    /* The entry's object may be gone, if it was destroyed. */
+    object = (entry) ? cache_retrieve(entry->loc) : NULL;
+    if (object) {
+	slot = entry->slot;
+	if (slot < object->methods.size && object->methods.tab[slot].m &&
+	    object->methods.tab[slot].m->name == name) {
+	    method_cache_hits++;
+	    return object->methods.tab[slot].m;
 	}
+	cache_discard(object);
     }
 
-    if (method)
-	method_cache_set(dbref, name, -1, method->object->dbref);
+    method = object_find_method(dbref, name);
+    if (!method)
+	return NULL;
+
+    /* Find the method's slot in its object's method table. */
+    object = method->object;
+    slot = object->methods.hashtab[ident_hash(name) % object->methods.size];
+    while (object->methods.tab[slot].m != method)
+	slot = object->methods.tab[slot].next;
+
+    /* Reuse the stale entry if there was one; otherwise replace entries in
+     * rotation. */
+    if (!entry) {
+	entry = &cache->entries[cache->next];
+	cache->next = (cache->next + 1) % MESSAGE_CACHE_ENTRIES;
+    }
+    if (entry->stamp)
+	ident_discard(entry->name);
+    entry->stamp = method_clock;
+    entry->dbref = dbref;
+    entry->name = ident_dup(name);
+    entry->loc = object->dbref;
+    entry->slot = slot;
+
     return method;
 }
 
@@ -689,108 +1083,58 @@ Method *object_find_method(long dbref, long name)
  * reference count, in order to keep it in cache.  dbref must be valid. */
 Method *object_find_next_method(long dbref, long name, long after)
 {
-    Search_params params;
-    Object *object;
     Method *method;
-    List *parents;
-    Data *d;
-    long parent;
 
     /* Check cache. */
     method = method_cache_check(dbref, name, after);
     if (method)
 	return method;
 
-    object = cache_retrieve(dbref);
-    parents = object->parents;
-
-    if (list_length(parents) == 1) {
-	/* Object has only one parent; search recursively. */
-	parent = list_elem(parents, 0)->u.dbref;
-	cache_discard(object);
-	if (dbref == after)
-	    method = object_find_method(parent, name);
-	else
-	    method = object_find_next_method(parent, name, after);
-    } else {
-	/* Object has more than one parent; use complicated search. */
-	cur_search++;
-	params.name = name;
-	params.stop_at = (dbref == after) ? -1 : after;
-	params.done = 0;
-	params.last_method_found = NULL;
-	for (d = list_last(parents); d; d = list_prev(parents, d))
-	    search_object(d->u.dbref, &params);
-
-	cache_discard(object);
-	method = params.last_method_found;
-    }
-
+    method = search_ancestors(dbref, name, after);
     if (method)
 	method_cache_set(dbref, name, after, method->object->dbref);
     return method;
 }
 
-/* Perform a reverse depth-first traversal of this object and its ancestors
- * with no repeat visits, thus searching ancestors before children and
- * searching parents right-to-left.  We will take the last method we find,
- * possibly stopping at a method if we were looking for the next method after
- * a given method. */
-static void search_object(long dbref, Search_params *params)
+/* Search dbref's linearized ancestors list, ancestors before children, and
+ * take the last method we find, unless we find a non-overridable method
+ * first.  If after is not -1, we are looking for the next method after a
+ * method on after, so we stop at after, and we don't search dbref itself.
+ * The same reference-counting kludge applies as for object_find_method(). */
+static Method *search_ancestors(long dbref, long name, long after)
 {
+    List *ancestors;
     Object *object;
-    Method *method;
-    List *parents;
-    Data *d;
-
-    object = cache_retrieve(dbref);
-
-    /* Don't search an object twice. */
-    if (object->search == cur_search) {
-	cache_discard(object);
-	return;
-    }
-    object->dirty = 1;
-    object->search = cur_search;
-
-    /* Grab the parents list and discard the object. */
-    parents = list_dup(object->parents);
-    cache_discard(object);
-
-    /* Traverse the parents list backwards. */
-    for (d = list_last(parents); d; d = list_prev(parents, d))
-	search_object(d->u.dbref, params);
-    list_discard(object->parents);
-
-    /* If the search is done, don't visit this object. */
-    if (params->done)
-	return;
+    Method *method = NULL, *local_method;
+    int i, len;
+
+    ancestors = object_linearize(dbref);
+    len = list_length(ancestors);
+    if (after != -1)
+	len--;
+
+    for (i = 0; i < len; i++) {
+	if (list_elem(ancestors, i)->u.dbref == after)
+	    break;
+	object = cache_retrieve(list_elem(ancestors, i)->u.dbref);
+	local_method = object_find_method_local(object, name);
+	if (local_method) {
+	    /* Discard the reference count on the last method found's object,
+	     * if we have one, and keep this one's. */
+	    if (method)
+		cache_discard(method->object);
+	    method = local_method;
 
-    /* If we were searching for a next method after a given object, then this
-     * might be the given object, in which case we should stop. */
-    if (dbref == params->stop_at) {
-	params->done = 1;
-	return;
+	    /* If this method is non-overridable, the search is done. */
+	    if (!method->overridable)
+		break;
+	} else {
+	    cache_discard(object);
+	}
     }
 
-    /* Visit this object.  First, get it back from the cache. */
-    object = cache_retrieve(dbref);
-    method = object_find_method_local(object, params->name);
-    if (method) {
-	/* We found a method on this object.  Discard the reference count on
-	 * the last method found's object, if we have one, and set this method
-	 * as the last one found.  Leave object's reference count there, since
-	 * we don't want it to get swapped out. */
-	if (params->last_method_found)
-	    cache_discard(params->last_method_found->object);
-	params->last_method_found = method;
-
-	/* If this method is non-overridable, the search is done. */
-	if (!method->overridable)
-	    params->done = 1;
-    } else {
-	cache_discard(object);
-    }
+    list_discard(ancestors);
+    return method;
 }
 
 /* Look for a method on an object. */
@@ -799,7 +1143,7 @@ static Method *object_find_method_local(Object *object, long name)
     int ind, method;
 
     /* Traverse hash table thread, stopping if we get a match on the name. */
-    ind = hash(ident_name(name)) % object->methods.size;
+    ind = ident_hash(name) % object->methods.size;
     method = object->methods.hashtab[ind];
     for (; method != -1; method = object->methods.tab[method].next) {
 	if (object->methods.tab[method].m->name == name)
@@ -815,14 +1159,19 @@ static Method *method_cache_check(long dbref, long name, long after)
     int i;
 
     i = (10 + dbref + (name << 4) + after) % METHOD_CACHE_SIZE;
-    if (method_cache[i].stamp == cur_stamp && method_cache[i].dbref == dbref &&
+    if (method_cache[i].stamp && method_cache[i].dbref == dbref &&
 	method_cache[i].name == name && method_cache[i].after == after &&
-	method_cache[i].loc != -1) {
+	method_cache[i].loc != -1 &&
+	method_cache_valid(method_cache[i].stamp, dbref)) {
+	/* Treat a location which has been destroyed as a miss. */
 	object = cache_retrieve(method_cache[i].loc);
-	return object_find_method_local(object, name);
-    } else {
-	return NULL;
+	if (object) {
+	    method_cache_hits++;
+	    return object_find_method_local(object, name);
+	}
     }
+    method_cache_misses++;
+    return NULL;
 }
 
 static void method_cache_set(long dbref, long name, long after, long loc)
@@ -832,19 +1181,63 @@ static void method_cache_set(long dbref, long name, long after, long loc)
     i = (10 + dbref + (name << 4) + after) % METHOD_CACHE_SIZE;
     if (method_cache[i].stamp != 0)
 	ident_discard(method_cache[i].name);
-    method_cache[i].stamp = cur_stamp;
+    method_cache[i].stamp = method_clock;
     method_cache[i].dbref = dbref;
     method_cache[i].name = ident_dup(name);
     method_cache[i].after = after;
     method_cache[i].loc = loc;
 }
 
+/* Returns true if a lookup on dbref made at stamp is still good.  This may
+ * retrieve dbref's ancestors from the cache to rebuild its ancestors list. */
+static int method_cache_valid(long stamp, long dbref)
+{
+    if (!ancestry_cached(dbref))
+	list_discard(object_linearize(dbref));
+    return stamp >= ancestry_check(dbref)->methods;
+}
+
+/* Returns true if an ancestors list for dbref made at stamp is still good. */
+static int ancestors_valid(long stamp, long dbref)
+{
+    return stamp >= ancestry_check(dbref)->parents;
+}
+
+/* Invalidate cached lookups for object and its descendants, and their
+ * ancestors lists if parents_changed is true.  Its descendants have object
+ * in their ancestors lists, so bumping object's versions is enough. */
+static void method_cache_invalidate(Object *object, int parents_changed)
+{
+    method_version_bump(object->dbref, parents_changed);
+    method_cache_invalidations++;
+}
+
+static void method_version_bump(long dbref, int parents_changed)
+{
+    long new_size, i;
+
+    if (dbref >= method_versions_size) {
+	new_size = method_versions_size * 2 + MALLOC_DELTA;
+	if (new_size <= dbref)
+	    new_size = dbref + MALLOC_DELTA;
+	method_versions = EREALLOC(method_versions, struct method_version,
+				   new_size);
+	for (i = method_versions_size; i < new_size; i++)
+	    method_versions[i].methods = method_versions[i].parents = 0;
+	method_versions_size = new_size;
+    }
+
+    method_versions[dbref].methods = ++method_clock;
+    if (parents_changed)
+	method_versions[dbref].parents = method_clock;
+}
+
 void object_add_method(Object *object, long name, Method *method)
 {
     int ind, hval;
 
-    /* Invalidate the method cache. */
-    cur_stamp++;
+    /* Invalidate cached lookups for this object and its descendants. */
+    method_cache_invalidate(object, 0);
 
     /* Delete the method if it previous existed. */
     object_del_method(object, name);
@@ -865,7 +1258,7 @@ void object_add_method(Object *object, long name, Method *method)
 	for (i = 0; i < new_size; i++)
 	    object->methods.hashtab[i] = -1;
 	for (i = 0; i < object->methods.size; i++) {
-	    ind = hash(ident_name(object->methods.tab[i].m->name)) % new_size;
+	    ind = ident_hash(object->methods.tab[i].m->name) % new_size;
 	    object->methods.tab[i].next = object->methods.hashtab[ind];
 	    object->methods.hashtab[ind] = i;
 	}
@@ -890,7 +1283,7 @@ void object_add_method(Object *object, long name, Method *method)
     object->methods.tab[ind].m = method_grab(method);
 
     /* Add method to hash table thread. */
-    hval = hash(ident_name(name)) % object->methods.size;
+    hval = ident_hash(name) % object->methods.size;
     object->methods.tab[ind].next = object->methods.hashtab[hval];
     object->methods.hashtab[hval] = ind;
 
@@ -901,18 +1294,17 @@ int object_del_method(Object *object, long name)
 {
     int *indp, ind;
 
-    /* Invalidate the method cache. */
-    cur_stamp++;
-
     /* This is the index-thread equivalent of double pointers in a standard
      * linked list.  We traverse the list using pointers to the ->next element
      * of the method pointers. */
-    ind = hash(ident_name(name)) % object->methods.size;
+    ind = ident_hash(name) % object->methods.size;
     indp = &object->methods.hashtab[ind];
     for (; *indp != -1; indp = &object->methods.tab[*indp].next) {
 	ind = *indp;
 	if (object->methods.tab[ind].m->name == name) {
-	    /* We found the method; discard it. */
+	    /* We found the method; invalidate cached lookups which might
+	     * have found it, and discard it. */
+	    method_cache_invalidate(object, 0);
 	    method_discard(object->methods.tab[ind].m);
 	    object->methods.tab[ind].m = NULL;
 
@@ -954,6 +1346,20 @@ void method_free(Method *method)
     if (method->num_vars)
 	TFREE(method->varnames, method->num_vars);
     TFREE(method->opcodes, method->num_opcodes);
+    if (method->tick_marks)
+	TFREE(method->tick_marks, method->num_tick_marks);
+    if (method->num_var_caches)
+	TFREE(method->var_caches, method->num_var_caches);
+    if (method->num_message_caches) {
+	/* Discard identifiers held in the method's message caches. */
+	for (i = 0; i < method->num_message_caches; i++) {
+	    for (j = 0; j < MESSAGE_CACHE_ENTRIES; j++) {
+		if (method->message_caches[i].entries[j].stamp)
+		    ident_discard(method->message_caches[i].entries[j].name);
+	    }
+	}
+	TFREE(method->message_caches, method->num_message_caches);
+    }
     if (method->num_error_lists) {
 	/* Discard identifiers held in the method's error lists. */
 	for (i = 0; i < method->num_error_lists; i++) {
@@ -966,6 +1372,122 @@ void method_free(Method *method)
     free(method);
 }
 
+/* Set up the parts of a method which we don't save with it: empty variable
+ * and message caches.  The instruction counts used to charge ticks (see
+ * method_count()) wait until the method first runs. */
+void method_prepare(Method *method)
+{
+    int i, j;
+
+    if (method->num_var_caches) {
+	method->var_caches = TMALLOC(Var_cache, method->num_var_caches);
+	for (i = 0; i < method->num_var_caches; i++) {
+	    method->var_caches[i].class_slot = -1;
+	    method->var_caches[i].slot = -1;
+	}
+    }
+
+    if (method->num_message_caches) {
+	method->message_caches = TMALLOC(Message_cache,
+					 method->num_message_caches);
+	for (i = 0; i < method->num_message_caches; i++) {
+	    for (j = 0; j < MESSAGE_CACHE_ENTRIES; j++)
+		method->message_caches[i].entries[j].stamp = 0;
+	    method->message_caches[i].next = 0;
+	}
+    }
+
+    method->tick_marks = NULL;
+    method->num_tick_marks = 0;
+}
+
+/* Effects:	Returns the number of slots taken by the instruction at pos in
+ *		method, including its arguments. */
+static int instr_len(Method *method, int pos)
+{
+    Op_info *info;
+
+    info = &op_table[method->opcodes[pos]];
+    return 1 + (info->arg1 != 0) + (info->arg2 != 0);
+}
+
+/* Modifies:	method
+ * Effects:	Records the instruction counts at the start of method, at each
+ *		instruction which can jump, and at each jump target, in order
+ *		of pc. */
+static void method_mark_ticks(Method *method)
+{
+    int i, n, count, len;
+    char *marked;
+    Op_info *info;
+
+    marked = TMALLOC(char, method->num_opcodes + 1);
+    memset(marked, 0, method->num_opcodes + 1);
+    marked[0] = 1;
+    for (i = 0; i < method->num_opcodes; i += len) {
+	info = &op_table[method->opcodes[i]];
+	len = instr_len(method, i);
+	if (info->arg1 == JUMP)
+	    marked[i] = marked[method->opcodes[i + 1]] = 1;
+	if (info->arg2 == JUMP)
+	    marked[i] = marked[method->opcodes[i + 2]] = 1;
+    }
+
+    /* Jumps only go to instruction starts, so only those are marked. */
+    n = marked[method->num_opcodes];
+    for (i = 0; i < method->num_opcodes; i += instr_len(method, i))
+	n += marked[i];
+    method->tick_marks = TMALLOC(Tick_mark, n);
+    method->num_tick_marks = n;
+
+    n = count = 0;
+    for (i = 0; i <= method->num_opcodes; i += instr_len(method, i)) {
+	if (marked[i]) {
+	    method->tick_marks[n].pc = i;
+	    method->tick_marks[n++].count = count;
+	}
+	if (i == method->num_opcodes)
+	    break;
+	count++;
+    }
+    TFREE(marked, method->num_opcodes + 1);
+}
+
+/* Modifies:	method
+ * Effects:	Returns the number of instructions in method which start
+ *		before pc, so an instruction's argument slots count the
+ *		instruction itself.  Frames charge ticks by this count when
+ *		they jump; see frame_jump() in execute.c.  We count from the
+ *		nearest mark at or before pc, which is the jump itself when pc
+ *		is in one.  The marks are made the first time the method
+ *		runs. */
+int method_count(Method *method, int pc)
+{
+    int low, high, mid, pos, count;
+
+    if (!method->tick_marks)
+	method_mark_ticks(method);
+
+    /* The first mark is at pc 0, so there is always one at or before pc. */
+    low = 0;
+    high = method->num_tick_marks - 1;
+    while (low < high) {
+	mid = (low + high + 1) / 2;
+	if (method->tick_marks[mid].pc <= pc)
+	    low = mid;
+	else
+	    high = mid - 1;
+    }
+
+    pos = method->tick_marks[low].pc;
+    count = method->tick_marks[low].count;
+    while (pos < pc) {
+	pos += instr_len(method, pos);
+	count++;
+    }
+    return count;
+}
+
 /* Delete references to object variables and strings in a method's code. */
 void method_delete_code_refs(Method *method)
 {
@@ -19,17 +19,40 @@ typedef struct object		Object;
 typedef struct string_entry	String_entry;
 typedef struct ident_entry	Ident_entry;
 typedef struct var		Var;
+typedef struct var_cache	Var_cache;
+typedef struct message_cache	Message_cache;
 typedef struct method		Method;
+typedef struct tick_mark	Tick_mark;
 typedef struct error_list	Error_list;
 typedef int			Object_string;
 typedef int			Object_ident;
+typedef int			Opcode;
 
 #include <stdio.h>
 #include "data.h"
 
 struct object {
     List *parents;
-    List *children;
+
+    /* Children are stored in a table like variables, so that objects with
+     * many children can add and remove them quickly.  A second thread keeps
+     * them in the order they were added; we cache a list of them in that
+     * order for children(). */
+    struct {
+	struct child {
+	    Dbref dbref;
+	    int next;
+	    int prev_added;
+	    int next_added;
+	} *tab;
+	int *hashtab;
+	int blanks;
+	int first;
+	int last;
+	int num;
+	int size;
+	List *list;
+    } children;
 
     /* Variables are stored in a table, with index threads starting at the
      * hash table entries.  There is also an index thread for blanks.  This
@@ -105,6 +128,39 @@ struct var {
     int next;
 };
 
+/* A variable cache remembers where a GET_OBJ_VAR or SET_OBJ_VAR instruction
+ * last found its variable, both on the object defining the method and on the
+ * object running it.  The slots are only hints, and are checked against the
+ * variable tables before we use them. */
+struct var_cache {
+    int class_slot;
+    int slot;
+};
+
+/* The number of instructions which start before pc, recorded at jumps and
+ * jump targets; see method_count(). */
+struct tick_mark {
+    int pc;
+    int count;
+};
+
+/* A message cache remembers where a MESSAGE or EXPR_MESSAGE instruction found
+ * methods for its last few receivers, as the defining object and the method's
+ * slot in that object's method table.  An entry is good as long as the method
+ * cache stamp hasn't changed since we filled it in. */
+#define MESSAGE_CACHE_ENTRIES 4
+
+struct message_cache {
+    struct message_cache_entry {
+	long stamp;
+	Dbref dbref;
+	Ident name;
+	Dbref loc;
+	int slot;
+    } entries[MESSAGE_CACHE_ENTRIES];
+    int next;
+};
+
 struct method {
     Ident name;
     Object *object;
@@ -113,8 +169,15 @@ struct method {
     Object_ident rest;
     int num_vars;
     Object_ident *varnames;
+    int max_stack;		/* Stack slots needed above the variables. */
     int num_opcodes;
-    long *opcodes;
+    Opcode *opcodes;		/* Opcodes and arguments, 32 bits each. */
+    Tick_mark *tick_marks;	/* Instruction counts at jumps, or NULL. */
+    int num_tick_marks;
+    int num_var_caches;
+    Var_cache *var_caches;
+    int num_message_caches;
+    Message_cache *message_caches;
     int num_error_lists;
     Error_list *error_lists;
     int overridable;
@@ -127,12 +190,16 @@ struct error_list {
 };
 
 Object *object_new(long dbref, List *parents);
+List *object_new_many(List *parents, int n);
 void object_free(Object *object);
 void object_destroy(Object *object);
 
 void object_construct_ancprec(Object *object);
 
 int object_change_parents(Object *object, List *parents);
+List *object_children(Object *object);
+void object_add_child(Object *object, long dbref);
+void object_del_child(Object *object, long dbref);
 List *object_ancestors(long dbref);
 int object_has_ancestor(long dbref, long ancestor);
 void object_reconstruct_descendent_ancprec(long dbref);
@@ -147,16 +214,21 @@ long object_get_ident(Object *object, int ind);
 
 long object_add_param(Object *object, long name);
 long object_del_param(Object *object, long name);
-long object_assign_var(Object *object, Object *class, long name, Data *val);
-long object_retrieve_var(Object *object, Object *class, long name, Data *ret);
+long object_assign_var(Object *object, Object *class, long name, Data *val,
+		       Var_cache *cache);
+long object_retrieve_var(Object *object, Object *class, long name, Data *ret,
+			 Var_cache *cache);
 void object_put_var(Object *object, long class, long name, Data *val);
 
 Method *object_find_method(long dbref, long name);
+Method *object_find_method_cached(long dbref, long name, Message_cache *cache);
 Method *object_find_next_method(long dbref, long name, long after);
 void object_add_method(Object *object, long name, Method *method);
 int object_del_method(Object *object, long name);
 List *object_list_method(Object *object, long name, int indent, int parens);
 void method_free(Method *method);
+void method_prepare(Method *method);
+int method_count(Method *method, int pc);
 Method *method_grab(Method *method);
 void method_discard(Method *method);
 
@@ -87,7 +87,7 @@ void op_set_var(void)
 	return;
 
     result = object_assign_var(cur_frame->object, cur_frame->method->object,
-			       args[0].u.symbol, &args[1]);
+			       args[0].u.symbol, &args[1], NULL);
     if (result == paramnf_id) {
 	throw(paramnf_id, "No such parameter %I.", args[0].u.symbol);
     } else {
@@ -106,7 +106,7 @@ void op_get_var(void)
 	return;
 
     result = object_retrieve_var(cur_frame->object, cur_frame->method->object,
-				 args[0].u.symbol, &d);
+				 args[0].u.symbol, &d, NULL);
     if (result == paramnf_id) {
 	throw(paramnf_id, "No such parameter %I.", args[0].u.symbol);
     } else {
@@ -169,7 +169,6 @@ void op_methods(void)
     }
 
     /* Push the list onto the stack. */
-    check_stack(1);
     push_list(methods);
     list_discard(methods);
 }
@@ -274,12 +273,16 @@ void op_parents(void)
 
 void op_children(void)
 {
+    List *children;
+
     /* Accept no arguments. */
     if (!func_init_0())
 	return;
 
     /* Push the children list onto the stack. */
-    push_list(cur_frame->object->children);
+    children = object_children(cur_frame->object);
+    push_list(children);
+    list_discard(children);
 }
 
 void op_ancestors(void)
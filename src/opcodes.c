@@ -20,7 +20,7 @@ static Op_info op_info[] = {
     { COMMENT,		"COMMENT",		op_comment, STRING },
     { POP,		"POP",			op_pop },
     { SET_LOCAL,	"SET_LOCAL",		op_set_local, VAR },
-    { SET_OBJ_VAR,	"SET_OBJ_VAR",		op_set_obj_var, IDENT },
+    { SET_OBJ_VAR,	"SET_OBJ_VAR",		op_set_obj_var, IDENT, INTEGER },
     { IF,		"IF",			op_if, JUMP },
     { IF_ELSE,		"IF_ELSE",		op_if, JUMP },
     { ELSE,		"ELSE",			op_else, JUMP },
@@ -42,6 +42,10 @@ static Op_info op_info[] = {
     { CATCH,		"CATCH",		op_catch, JUMP, ERROR },
     { CATCH_END,	"CATCH_END",		op_catch_end, JUMP },
     { HANDLER_END,	"HANDLER_END",		op_handler_end },
+    { FORK,		"FORK",			op_fork, JUMP },
+    { FORK_END,		"FORK_END",		op_fork_end },
+    { ATOMIC,		"ATOMIC",		op_atomic, JUMP },
+    { ATOMIC_END,	"ATOMIC_END",		op_atomic_end },
 
     { ZERO,		"ZERO",			op_zero },
     { ONE,		"ONE",			op_one },
@@ -52,11 +56,14 @@ static Op_info op_info[] = {
     { ERROR,		"ERROR",		op_error, IDENT },
     { NAME,		"NAME",			op_name, IDENT },
     { GET_LOCAL,	"GET_LOCAL",		op_get_local, VAR },
-    { GET_OBJ_VAR,	"GET_OBJ_VAR",		op_get_obj_var,	IDENT },
+    { GET_OBJ_VAR,	"GET_OBJ_VAR",		op_get_obj_var,	IDENT, INTEGER },
     { START_ARGS,	"START_ARGS",		op_start_args },
     { PASS,		"PASS",			op_pass },
-    { MESSAGE,		"MESSAGE",		op_message, IDENT },
-    { EXPR_MESSAGE,	"EXPR_MESSAGE",		op_expr_message },
+    { MESSAGE,		"MESSAGE",		op_message, IDENT, INTEGER },
+    { EXPR_MESSAGE,	"EXPR_MESSAGE",		op_expr_message, INTEGER },
+    { TAIL_PASS,	"TAIL_PASS",		op_tail_pass },
+    { TAIL_MESSAGE,	"TAIL_MESSAGE",		op_tail_message, IDENT, INTEGER },
+    { TAIL_EXPR_MESSAGE, "TAIL_EXPR_MESSAGE",	op_tail_expr_message, INTEGER },
     { LIST,		"LIST",			op_list },
     { DICT,		"DICT",			op_dict },
     { BUFFER,		"BUFFER",		op_buffer },
@@ -70,6 +77,10 @@ static Op_info op_info[] = {
     { CRITICAL_END,	"CRITICAL_END", 	op_critical_end },
     { PROPAGATE,	"PROPAGATE",		op_propagate, JUMP },
     { PROPAGATE_END,	"PROPAGATE_END",	op_propagate_end },
+    { GET_LOCAL_LOCAL,	"GET_LOCAL_LOCAL",	op_get_local_local, VAR, VAR },
+    { BIG_INTEGER,	"BIG_INTEGER",		op_big_integer, INTEGER, INTEGER },
+    { FOR_LIST_LIST,	"FOR_LIST_LIST",	op_for_list_list, JUMP, INTEGER },
+    { INDEX_LIST_INT,	"INDEX_LIST_INT",	op_index_list_int },
 
     /* Arithmetic and relational operators (arithop.c). */
     { '!',		"!",			op_not },
@@ -87,6 +98,20 @@ static Op_info op_info[] = {
     { '<',		"<",			op_less },
     { LE,		"<=",			op_less_or_equal },
     { IN,		"IN",			op_in },
+    { ADD_INTEGER,	"ADD_INTEGER",		op_add_integer, INTEGER },
+    { SUBTRACT_INTEGER,	"SUBTRACT_INTEGER",	op_subtract_integer, INTEGER },
+    { MULTIPLY_INTEGER,	"MULTIPLY_INTEGER",	op_multiply_integer, INTEGER },
+    { DIVIDE_INTEGER,	"DIVIDE_INTEGER",	op_divide_integer, INTEGER },
+    { LESS_INTEGER,	"LESS_INTEGER",		op_less_integer, INTEGER },
+    { ADD_INT_INT,	"ADD_INT_INT",		op_add_int_int },
+    { SUBTRACT_INT_INT,	"SUBTRACT_INT_INT",	op_subtract_int_int },
+    { EQUAL_INT_INT,	"EQUAL_INT_INT",	op_equal_int_int },
+    { NOT_EQUAL_INT_INT, "NOT_EQUAL_INT_INT",	op_not_equal_int_int },
+    { GREATER_INT_INT,	"GREATER_INT_INT",	op_greater_int_int },
+    { GREATER_OR_EQUAL_INT_INT, "GREATER_OR_EQUAL_INT_INT",
+						op_greater_or_equal_int_int },
+    { LESS_INT_INT,	"LESS_INT_INT",		op_less_int_int },
+    { LESS_OR_EQUAL_INT_INT, "LESS_OR_EQUAL_INT_INT", op_less_or_equal_int_int },
 
     /* Generic data manipulation (dataop.c). */
     { TYPE,		"type",			op_type },
@@ -156,6 +181,7 @@ static Op_info op_info[] = {
     { SENDER,		"sender",		op_sender },
     { CALLER,		"caller",		op_caller },
     { TASK_ID,		"task_id",		op_task_id },
+    { SUSPEND,		"suspend",		op_suspend },
 
     /* Error handling operations (errorop.c). */
     { ERROR_FUNC,	"error",		op_error_func },
@@ -203,18 +229,46 @@ static Op_info op_info[] = {
     { DATA,		"data",			op_data },
     { SET_NAME,		"set_name",		op_set_name },
     { DEL_NAME,		"del_name",		op_del_name },
-    { DB_TOP,		"db_top",		op_db_top }
+    { DB_TOP,		"db_top",		op_db_top },
+    { METHOD_CACHE_STATS, "method_cache_stats", op_method_cache_stats },
+    { CREATE_MANY,	"create_many",		op_create_many },
+    { DESTROY_MANY,	"destroy_many",		op_destroy_many },
+    { RESUME,		"resume",		op_resume },
+    { CANCEL,		"cancel",		op_cancel },
+    { SCHEDULE,		"schedule",		op_schedule },
+    { QUERY,		"query",		op_query },
+    { CANCEL_QUERY,	"cancel_query",		op_cancel_query }
 
 };
 
+/* Quickened opcodes, and the general opcodes they stand in for. */
+static struct {
+    long opcode;
+    long general;
+} quickened[] = {
+    { FOR_LIST_LIST,		FOR_LIST },
+    { INDEX_LIST_INT,		INDEX },
+    { ADD_INT_INT,		'+' },
+    { SUBTRACT_INT_INT,		'-' },
+    { EQUAL_INT_INT,		EQ },
+    { NOT_EQUAL_INT_INT,	NE },
+    { GREATER_INT_INT,		'>' },
+    { GREATER_OR_EQUAL_INT_INT,	GE },
+    { LESS_INT_INT,		'<' },
+    { LESS_OR_EQUAL_INT_INT,	LE }
+};
+
 void init_op_table(void)
 {
     int i;
 
     for (i = 0; i < NUM_OPERATORS; i++) {
 	op_info[i].symbol = ident_get(op_info[i].name);
+	op_info[i].general = op_info[i].opcode;
 	op_table[op_info[i].opcode] = op_info[i];
     }
+    for (i = 0; i < sizeof(quickened) / sizeof(*quickened); i++)
+	op_table[quickened[i].opcode].general = quickened[i].general;
 
     /* Look for first opcode with a lowercase name to find the first
      * function. */
@@ -237,3 +291,10 @@ int find_function(char *name)
     return -1;
 }
 
+/* Returns the opcode which opcode is a quickened form of, or opcode if it
+ * isn't one. */
+int op_general(int opcode)
+{
+    return op_table[opcode].general;
+}
+
@@ -14,12 +14,14 @@ struct op_info {
     int arg1;
     int arg2;
     Ident symbol;
+    long general;
 };
 
 extern Op_info op_table[LAST_TOKEN];
 
 void init_op_table(void);
 int find_function(char *name);
+int op_general(int opcode);
 
 #endif
 
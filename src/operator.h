@@ -28,6 +28,10 @@ void op_return_expr(void);
 void op_catch(void);
 void op_catch_end(void);
 void op_handler_end(void);
+void op_fork(void);
+void op_fork_end(void);
+void op_atomic(void);
+void op_atomic_end(void);
 
 void op_zero(void);
 void op_one(void);
@@ -43,6 +47,9 @@ void op_start_args(void);
 void op_pass(void);
 void op_message(void);
 void op_expr_message(void);
+void op_tail_pass(void);
+void op_tail_message(void);
+void op_tail_expr_message(void);
 void op_list(void);
 void op_dict(void);
 void op_buffer(void);
@@ -56,6 +63,13 @@ void op_critical(void);
 void op_critical_end(void);
 void op_propagate(void);
 void op_propagate_end(void);
+void op_get_local_local(void);
+void op_big_integer(void);
+
+/* Quickened syntax operators, installed by quicken() in place of the
+ * general ones above (syntaxop.c). */
+void op_for_list_list(void);
+void op_index_list_int(void);
 
 /* Arithmetic and relational operators (arithop.c). */
 void op_not(void);
@@ -74,6 +88,22 @@ void op_greater_or_equal(void);
 void op_less(void);
 void op_less_or_equal(void);
 void op_in(void);
+void op_add_integer(void);
+void op_subtract_integer(void);
+void op_multiply_integer(void);
+void op_divide_integer(void);
+void op_less_integer(void);
+
+/* Quickened arithmetic and relational operators, installed by quicken() in
+ * place of the general ones above (arithop.c). */
+void op_add_int_int(void);
+void op_subtract_int_int(void);
+void op_equal_int_int(void);
+void op_not_equal_int_int(void);
+void op_greater_int_int(void);
+void op_greater_or_equal_int_int(void);
+void op_less_int_int(void);
+void op_less_or_equal_int_int(void);
 
 /* Generic data manipulation (dataop.c). */
 void op_type(void);
@@ -143,6 +173,7 @@ void op_definer();
 void op_sender();
 void op_caller();
 void op_task_id();
+void op_suspend();
 
 /* Error handling operators (errorop.c). */
 void op_error_func(void);
@@ -191,6 +222,14 @@ void op_data(void);
 void op_set_name(void);
 void op_del_name(void);
 void op_db_top(void);
+void op_method_cache_stats(void);
+void op_create_many(void);
+void op_destroy_many(void);
+void op_resume(void);
+void op_cancel(void);
+void op_schedule(void);
+void op_query(void);
+void op_cancel_query(void);
 
 #endif
 
@@ -100,7 +100,9 @@ String *string_unpack(FILE *fp)
     if (len == -1)
 	return NULL;
     str = string_new(len);
-    fread(str->s, sizeof(char), str->len, fp);
+    str->len = len;
+    fread(str->s, sizeof(char), len, fp);
+    str->s[len] = 0;
     return str;
 }
 
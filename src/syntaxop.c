@@ -12,6 +12,7 @@
 #include "cache.h"
 #include "cmstring.h"
 #include "lookup.h"
+#include "opcodes.h"
 
 void op_comment(void)
 {
@@ -40,12 +41,15 @@ void op_set_obj_var(void)
 {
     long ind, id, result;
     Data *val;
+    Var_cache *cache;
 
     ind = cur_frame->opcodes[cur_frame->pc++];
     id = object_get_ident(cur_frame->method->object, ind);
+    cache = cur_frame->method->var_caches;
+    cache += cur_frame->opcodes[cur_frame->pc++];
     val = &stack[stack_pos - 1];
     result = object_assign_var(cur_frame->object, cur_frame->method->object,
-			       id, val);
+			       id, val, cache);
     if (result == paramnf_id)
 	throw(paramnf_id, "No such parameter %I.", id);
     else
@@ -56,7 +60,7 @@ void op_if(void)
 {
     /* Jump if the condition is false. */
     if (!data_true(&stack[stack_pos - 1]))
-	cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+	frame_jump(cur_frame->opcodes[cur_frame->pc]);
     else
 	cur_frame->pc++;
     pop(1);
@@ -64,7 +68,7 @@ void op_if(void)
 
 void op_else(void)
 {
-    cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+    frame_jump(cur_frame->opcodes[cur_frame->pc]);
 }
 
 void op_for_range(void)
@@ -85,7 +89,7 @@ void op_for_range(void)
     if (range[0].u.val > range[1].u.val) {
 	/* We're finished; pop the range and jump to the end. */
 	pop(2);
-	cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+	frame_jump(cur_frame->opcodes[cur_frame->pc]);
     } else {
 	/* Replace the index variable with the lower range bound, increment the
 	 * range, and continue. */
@@ -113,23 +117,32 @@ void op_for_list(void)
 	return;
     }
 
+    if (domain->type == LIST)
+	quicken(cur_frame->pc - 1, FOR_LIST_LIST);
+
     len = (domain->type == LIST) ? list_length(domain->u.list)
 				 : dict_size(domain->u.dict);
 
     if (counter->u.val >= len) {
 	/* We're finished; pop the list and counter and jump to the end. */
 	pop(2);
-	cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+	frame_jump(cur_frame->opcodes[cur_frame->pc]);
 	return;
     }
 
     /* Replace the index variable with the next list element and increment
-     * the counter. */
-    data_discard(&stack[var]);
+     * the counter.  For a dictionary, the pair from the last iteration is
+     * reused if the loop body didn't hold on to it. */
     if (domain->type == LIST) {
+	data_discard(&stack[var]);
 	data_dup(&stack[var], list_elem(domain->u.list, counter->u.val));
+    } else if (stack[var].type == LIST) {
+	stack[var].u.list = dict_reuse_key_value_pair(domain->u.dict,
+						      counter->u.val,
+						      stack[var].u.list);
     } else {
 	pair = dict_key_value_pair(domain->u.dict, counter->u.val);
+	data_discard(&stack[var]);
 	stack[var].type = LIST;
 	stack[var].u.list = pair;
     }
@@ -141,7 +154,7 @@ void op_while(void)
 {
     if (!data_true(&stack[stack_pos - 1])) {
 	/* The condition expression is false.  Jump to the end of the loop. */
-	cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+	frame_jump(cur_frame->opcodes[cur_frame->pc]);
     } else {
 	/* The condition expression is true; continue. */
 	cur_frame->pc += 2;
@@ -164,7 +177,7 @@ void op_case_value(void)
      * Otherwise, just pop the value for this case, and go on. */
     if (data_cmp(&stack[stack_pos - 2], &stack[stack_pos - 1]) == 0) {
 	pop(2);
-	cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+	frame_jump(cur_frame->opcodes[cur_frame->pc]);
     } else {
 	pop(1);
 	cur_frame->pc++;
@@ -202,7 +215,7 @@ void op_case_range(void)
      * Otherwise, just pop the range and go on. */
     if (is_match) {
 	pop(3);
-	cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+	frame_jump(cur_frame->opcodes[cur_frame->pc]);
     } else {
 	pop(2);
 	cur_frame->pc++;
@@ -220,7 +233,7 @@ void op_last_case_value(void)
 	cur_frame->pc++;
     } else {
 	pop(1);
-	cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+	frame_jump(cur_frame->opcodes[cur_frame->pc]);
     }
 }
 
@@ -258,14 +271,14 @@ void op_last_case_range(void)
 	cur_frame->pc++;
     } else {
 	pop(2);
-	cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+	frame_jump(cur_frame->opcodes[cur_frame->pc]);
     }
 }
 
 void op_end_case(void)
 {
     /* Jump to end of switch statement. */
-    cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+    frame_jump(cur_frame->opcodes[cur_frame->pc]);
 }
 
 void op_default(void)
@@ -277,43 +290,60 @@ void op_default(void)
 void op_end(void)
 {
     /* Jump to the beginning of the loop or condition expression. */
-    cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+    frame_loop(cur_frame->opcodes[cur_frame->pc]);
 }
 
 void op_break(void)
 {
-    int n, op;
+    int n, op, i;
 
-    /* Get loop instruction from argument. */
+    /* Get loop instruction from argument, and pop the error action
+     * specifiers of the catch and atomic statements we are leaving. */
     n = cur_frame->opcodes[cur_frame->pc];
+    for (i = cur_frame->opcodes[cur_frame->pc + 1]; i > 0; i--)
+	pop_error_action_specifier();
 
     /* If it's a for loop, pop the loop information on the stack (either a list
      * and an index, or two range bounds. */
-    op = cur_frame->opcodes[n];
+    op = op_general(cur_frame->opcodes[n]);
     if (op == FOR_LIST || op == FOR_RANGE)
 	pop(2);
 
     /* Jump to the end of the loop. */
-    cur_frame->pc = cur_frame->opcodes[n + 1];
+    frame_jump(cur_frame->opcodes[n + 1]);
 }
 
 void op_continue(void)
 {
+    int n, i;
+
+    /* Pop the error action specifiers of the catch and atomic statements we
+     * are leaving. */
+    for (i = cur_frame->opcodes[cur_frame->pc + 1]; i > 0; i--)
+	pop_error_action_specifier();
+
     /* Jump back to the beginning of the loop.  If it's a WHILE loop, jump back
      * to the beginning of the condition expression. */
-    cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
-    if (cur_frame->opcodes[cur_frame->pc] == WHILE)
-	cur_frame->pc = cur_frame->opcodes[cur_frame->pc + 2];
+    n = cur_frame->opcodes[cur_frame->pc];
+    if (cur_frame->opcodes[n] == WHILE)
+	n = cur_frame->opcodes[n + 2];
+    frame_loop(n);
 }
 
 void op_return(void)
 {
     long dbref;
+    Data d;
 
     dbref = cur_frame->object->dbref;
     frame_return();
-    if (cur_frame)
+    if (cur_frame) {
 	push_dbref(dbref);
+    } else {
+	d.type = DBREF;
+	d.u.dbref = dbref;
+	task_return(&d);
+    }
 }
 
 void op_return_expr(void)
@@ -329,7 +359,7 @@ void op_return_expr(void)
 	stack[stack_pos] = *val;
 	stack_pos++;
     } else {
-	data_discard(val);
+	task_return(val);
     }
 }
 
@@ -352,7 +382,7 @@ void op_catch_end(void)
     /* Pop the error action specifier for the catch statement, and jump past
      * the handler. */
     pop_error_action_specifier();
-    cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+    frame_jump(cur_frame->opcodes[cur_frame->pc]);
 }
 
 void op_handler_end(void)
@@ -360,6 +390,50 @@ void op_handler_end(void)
     pop_handler_info();
 }
 
+void op_fork(void)
+{
+    Data *delay = &stack[stack_pos - 1];
+
+    if (delay->type != INTEGER) {
+	throw(type_id, "Fork delay %D is not an integer.", delay);
+	return;
+    } else if (delay->u.val < 0) {
+	throw(range_id, "Fork delay (%l) is less than zero.", delay->u.val);
+	return;
+    }
+
+    /* Start a task running the body, and jump past the body. */
+    task_fork(cur_frame->pc + 1, delay->u.val);
+    pop(1);
+    frame_jump(cur_frame->opcodes[cur_frame->pc]);
+}
+
+void op_fork_end(void)
+{
+    /* The end of a fork statement's body is the end of the forked task. */
+    frame_return();
+}
+
+void op_atomic(void)
+{
+    Error_action_specifier *spec;
+
+    /* Push an error action specifier for the atomic statement.  It handles
+     * no errors, but while it is on a frame's stack, the task isn't
+     * preempted.  Skip the jump argument, which is for the decompiler. */
+    spec = EMALLOC(Error_action_specifier, 1);
+    spec->type = ATOMIC;
+    spec->stack_pos = stack_pos;
+    spec->next = cur_frame->specifiers;
+    cur_frame->specifiers = spec;
+    cur_frame->pc++;
+}
+
+void op_atomic_end(void)
+{
+    pop_error_action_specifier();
+}
+
 void op_zero(void)
 {
     /* Push a zero. */
@@ -377,6 +451,16 @@ void op_integer(void)
     push_int(cur_frame->opcodes[cur_frame->pc++]);
 }
 
+/* Effects: Pushes an integer too wide for one opcode argument, given as its
+ *	    high and low 32 bits. */
+void op_big_integer(void)
+{
+    long high = cur_frame->opcodes[cur_frame->pc++];
+    unsigned int low = cur_frame->opcodes[cur_frame->pc++];
+
+    push_int(high * 65536 * 65536 + (long) low);
+}
+
 void op_string(void)
 {
     String *str;
@@ -431,7 +515,6 @@ void op_get_local(void)
 
     /* Push value of local variable on stack. */
     var = cur_frame->var_start + cur_frame->opcodes[cur_frame->pc++];
-    check_stack(1);
     data_dup(&stack[stack_pos], &stack[var]);
     stack_pos++;
 }
@@ -440,16 +523,18 @@ void op_get_obj_var(void)
 {
     long ind, id, result;
     Data val;
+    Var_cache *cache;
 
     /* Look for variable, and push it onto the stack if we find it. */
     ind = cur_frame->opcodes[cur_frame->pc++];
     id = object_get_ident(cur_frame->method->object, ind);
+    cache = cur_frame->method->var_caches;
+    cache += cur_frame->opcodes[cur_frame->pc++];
     result = object_retrieve_var(cur_frame->object, cur_frame->method->object,
-				 id, &val);
+				 id, &val, cache);
     if (result == paramnf_id) {
 	throw(paramnf_id, "No such parameter %I.", id);
     } else {
-	check_stack(1);
 	stack[stack_pos] = val;
 	stack_pos++;
     }
@@ -491,9 +576,12 @@ void op_message(void)
     Data *target;
     long message, dbref;
     Frob *frob;
+    Message_cache *cache;
 
     ind = cur_frame->opcodes[cur_frame->pc++];
     message = object_get_ident(cur_frame->method->object, ind);
+    cache = cur_frame->method->message_caches;
+    cache += cur_frame->opcodes[cur_frame->pc++];
 
     arg_start = arg_starts[--arg_pos];
     target = &stack[arg_start - 1];
@@ -513,7 +601,7 @@ void op_message(void)
     }
 
     /* Attempt to send the message. */
-    result = send_message(dbref, message, target - stack, arg_start);
+    result = send_message(dbref, message, target - stack, arg_start, cache);
 
     if (result == numargs_id)
 	interp_error(result, numargs_str);
@@ -530,6 +618,10 @@ void op_expr_message(void)
     int arg_start, result;
     Data *target, *message_data;
     long dbref, message;
+    Message_cache *cache;
+
+    cache = cur_frame->method->message_caches;
+    cache += cur_frame->opcodes[cur_frame->pc++];
 
     arg_start = arg_starts[--arg_pos];
     target = &stack[arg_start - 2];
@@ -562,7 +654,7 @@ void op_expr_message(void)
     }
 
     /* Attempt to send the message. */
-    result = send_message(dbref, message, target - stack, arg_start);
+    result = send_message(dbref, message, target - stack, arg_start, cache);
     ident_discard(message);
 
     if (result == numargs_id)
@@ -575,6 +667,36 @@ void op_expr_message(void)
 	throw(result, "Maximum call depth exceeded.");
 }
 
+/* The tail call versions are coded for a pass() or message whose result is
+ * returned right away.  If a new frame starts, it can take the place of ours;
+ * otherwise, the RETURN_EXPR after them returns as usual. */
+void op_tail_pass(void)
+{
+    Frame *frame = cur_frame;
+
+    op_pass();
+    if (cur_frame && cur_frame->caller_frame == frame)
+	frame_tail_call();
+}
+
+void op_tail_message(void)
+{
+    Frame *frame = cur_frame;
+
+    op_message();
+    if (cur_frame && cur_frame->caller_frame == frame)
+	frame_tail_call();
+}
+
+void op_tail_expr_message(void)
+{
+    Frame *frame = cur_frame;
+
+    op_expr_message();
+    if (cur_frame && cur_frame->caller_frame == frame)
+	frame_tail_call();
+}
+
 void op_list(void)
 {
     int start, len;
@@ -702,6 +824,7 @@ void op_index(void)
     } else {
 	/* Replace d with the element of d numbered by ind. */
 	if (d->type == LIST) {
+	    quicken(cur_frame->pc - 1, INDEX_LIST_INT);
 	    data_dup(&element, list_elem(d->u.list, i));
 	    pop(2);
 	    stack[stack_pos] = element;
@@ -719,7 +842,7 @@ void op_and(void)
 {
     /* Short-circuit if left side is false; otherwise discard. */
     if (!data_true(&stack[stack_pos - 1])) {
-	cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+	frame_jump(cur_frame->opcodes[cur_frame->pc]);
     } else {
 	cur_frame->pc++;
 	pop(1);
@@ -730,7 +853,7 @@ void op_or(void)
 {
     /* Short-circuit if left side is true; otherwise discard. */
     if (data_true(&stack[stack_pos - 1])) {
-	cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+	frame_jump(cur_frame->opcodes[cur_frame->pc]);
     } else {
 	cur_frame->pc++;
 	pop(1);
@@ -749,10 +872,13 @@ void op_splice(void)
     }
     list = stack[stack_pos - 1].u.list;
 
-    /* Splice the list onto the stack, overwriting the list. */
-    check_stack(list_length(list) - 1);
+    /* Splice the list onto the stack, overwriting the list.  The method's
+     * stack reservation only counted the list as one slot, so make room
+     * for the rest of the elements on top of it. */
+    check_stack(list_length(list) - 1 + cur_frame->method->max_stack);
+    i = 0;
     for (d = list_first(list); d; d = list_next(list, d))
-	data_dup(&stack[stack_pos - 1 + i], d);
+	data_dup(&stack[stack_pos - 1 + i++], d);
     stack_pos += list_length(list) - 1;
 
     list_discard(list);
@@ -796,3 +922,81 @@ void op_propagate_end(void)
     pop_error_action_specifier();
 }
 
+
+/* Effects: Pushes the values of two local variables.  This is a
+ *	    superinstruction standing in for two consecutive GET_LOCAL
+ *	    instructions; see peephole() in codegen.c. */
+void op_get_local_local(void)
+{
+    int var1, var2;
+
+    var1 = cur_frame->var_start + cur_frame->opcodes[cur_frame->pc++];
+    var2 = cur_frame->var_start + cur_frame->opcodes[cur_frame->pc++];
+    data_dup(&stack[stack_pos], &stack[var1]);
+    data_dup(&stack[stack_pos + 1], &stack[var2]);
+    stack_pos += 2;
+}
+
+/* The following are quickened versions of the operators above, which
+ * quicken() installs in place of an instruction's general operator once it
+ * has seen the types they handle.  Each checks that it still has those
+ * types, and if not, puts back the general operator and calls it. */
+
+/* Effects: Like op_for_list(), when iterating over a list. */
+void op_for_list_list(void)
+{
+    Data *counter, *domain;
+    int var;
+
+    counter = &stack[stack_pos - 1];
+    domain = &stack[stack_pos - 2];
+    if (domain->type != LIST) {
+	quicken(cur_frame->pc - 1, FOR_LIST);
+	op_for_list();
+	return;
+    }
+
+    if (counter->u.val >= list_length(domain->u.list)) {
+	/* We're finished; pop the list and counter and jump to the end. */
+	pop(2);
+	frame_jump(cur_frame->opcodes[cur_frame->pc]);
+	return;
+    }
+
+    /* Replace the index variable with the next list element and increment
+     * the counter. */
+    var = cur_frame->var_start + cur_frame->opcodes[cur_frame->pc + 1];
+    data_discard(&stack[var]);
+    data_dup(&stack[var], list_elem(domain->u.list, counter->u.val));
+    counter->u.val++;
+    cur_frame->pc += 2;
+}
+
+/* Effects: Like op_index(), when indexing a list by an integer.  Range errors
+ *	    are left to op_index(), without giving up the quickened form. */
+void op_index_list_int(void)
+{
+    Data *d, *ind, element;
+    int i;
+
+    d = &stack[stack_pos - 2];
+    ind = &stack[stack_pos - 1];
+    if (d->type != LIST || ind->type != INTEGER) {
+	quicken(cur_frame->pc - 1, INDEX);
+	op_index();
+	return;
+    }
+
+    i = ind->u.val - 1;
+    if (i < 0 || i >= list_length(d->u.list)) {
+	op_index();
+	return;
+    }
+
+    /* Replace the list with its element.  The index is an integer, so we
+     * can drop it without discarding it. */
+    data_dup(&element, list_elem(d->u.list, i));
+    stack_pos--;
+    data_discard(d);
+    *d = element;
+}
@@ -0,0 +1,239 @@
+/* timer.c: A hierarchical timer wheel, for tasks which start later. */
+
+#define _POSIX_SOURCE
+
+#include <time.h>
+#include "x.tab.h"
+#include "timer.h"
+#include "memory.h"
+#include "ident.h"
+#include "list.h"
+
+/* The wheel has WHEEL_LEVELS levels of WHEEL_SLOTS slots.  A slot on level 0
+ * holds the timers for one second, and a slot on each higher level holds the
+ * timers for as many seconds as the whole level below it.  A timer goes on
+ * the lowest level which reaches its time, and moves down when the level
+ * below comes back around to the start of its slot, so adding or removing a
+ * timer takes the same time however many there are.  A timer past the reach
+ * of the top level waits in the top level's farthest slot, and is placed
+ * again when that slot comes around. */
+#define WHEEL_BITS		6
+#define WHEEL_SLOTS		(1 << WHEEL_BITS)
+#define WHEEL_MASK		(WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS		4
+#define WHEEL_REACH		(1L << (WHEEL_BITS * WHEEL_LEVELS))
+
+/* We use MALLOC_DELTA to keep the table sizes at least 32 bytes below a power
+ * of two, assuming a pointer is four bytes. */
+#define MALLOC_DELTA		8
+#define INIT_TAB_SIZE		(128 - MALLOC_DELTA)
+
+#define HASH(id)		((unsigned long) (id) % hashtab_size)
+
+static void wheel_insert(Timer *timer);
+static void wheel_remove(Timer *timer);
+static void cascade(int level);
+static void rehash(void);
+
+static Timer *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static time_t wheel_time;	/* The next second to expire. */
+static Timer **hashtab;
+static long hashtab_size, num_timers;
+
+void init_timers(void)
+{
+    long i;
+
+    hashtab_size = INIT_TAB_SIZE;
+    hashtab = EMALLOC(Timer *, hashtab_size);
+    for (i = 0; i < hashtab_size; i++)
+	hashtab[i] = NULL;
+    time(&wheel_time);
+}
+
+/* Effects:	Returns a new timer with the ID id, which expires at when.  The
+ *		caller fills in the task or the message. */
+Timer *timer_add(long id, time_t when)
+{
+    Timer *timer;
+    long ind;
+
+    /* With nothing in the wheel, it can start from any time. */
+    if (!num_timers)
+	time(&wheel_time);
+
+    if (num_timers >= hashtab_size)
+	rehash();
+
+    timer = EMALLOC(Timer, 1);
+    timer->id = id;
+    timer->when = when;
+    timer->task = NULL;
+    timer->message = NOT_AN_IDENT;
+    timer->args = NULL;
+
+    ind = HASH(id);
+    timer->hash_next = hashtab[ind];
+    hashtab[ind] = timer;
+    num_timers++;
+
+    wheel_insert(timer);
+    return timer;
+}
+
+/* Effects:	Removes the timer with the ID id and returns it, or returns
+ *		NULL if there is none.  The caller discards it. */
+Timer *timer_take(long id)
+{
+    Timer **p, *timer;
+
+    for (p = &hashtab[HASH(id)]; *p; p = &(*p)->hash_next) {
+	if ((*p)->id == id) {
+	    timer = *p;
+	    *p = timer->hash_next;
+	    wheel_remove(timer);
+	    num_timers--;
+	    return timer;
+	}
+    }
+    return NULL;
+}
+
+/* Effects:	Removes a timer which has expired by now and returns it, or
+ *		returns NULL if there are no more.  The caller discards it. */
+Timer *timer_expire(time_t now)
+{
+    Timer *timer;
+    int level;
+
+    while (num_timers && wheel_time <= now) {
+	timer = wheel[0][wheel_time & WHEEL_MASK];
+	if (timer)
+	    return timer_take(timer->id);
+
+	/* Go on to the next second.  Each level which comes around to the
+	 * start of a slot of the level above brings that slot down. */
+	wheel_time++;
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+	    if ((wheel_time >> (WHEEL_BITS * (level - 1))) & WHEEL_MASK)
+		break;
+	    cascade(level);
+	}
+    }
+    return NULL;
+}
+
+/* Effects:	Returns the number of seconds from now until timer_expire()
+ *		next needs calling, or -1 if there are no timers.  This may be
+ *		before any timer expires, when a higher level comes down. */
+int timer_wait(time_t now)
+{
+    time_t t;
+
+    if (!num_timers)
+	return -1;
+
+    for (t = wheel_time; !wheel[0][t & WHEEL_MASK]; ) {
+	if (!(++t & WHEEL_MASK))
+	    break;
+    }
+    return (t <= now) ? 0 : t - now;
+}
+
+/* Effects:	Returns the timer after timer, or the first timer if timer is
+ *		NULL, in no particular order, or NULL if there are no more. */
+Timer *timer_next(Timer *timer)
+{
+    long ind;
+
+    if (timer && timer->hash_next)
+	return timer->hash_next;
+
+    for (ind = (timer) ? HASH(timer->id) + 1 : 0; ind < hashtab_size; ind++) {
+	if (hashtab[ind])
+	    return hashtab[ind];
+    }
+    return NULL;
+}
+
+void timer_discard(Timer *timer)
+{
+    if (timer->message != NOT_AN_IDENT)
+	ident_discard(timer->message);
+    if (timer->args)
+	list_discard(timer->args);
+    free(timer);
+}
+
+static void wheel_insert(Timer *timer)
+{
+    time_t when = timer->when;
+    int level;
+
+    if (when < wheel_time)
+	when = wheel_time;
+    else if (when - wheel_time >= WHEEL_REACH)
+	when = wheel_time + WHEEL_REACH - 1;
+
+    for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+	if (when - wheel_time < 1L << (WHEEL_BITS * (level + 1)))
+	    break;
+    }
+
+    timer->level = level;
+    timer->slot = (when >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    timer->prev = NULL;
+    timer->next = wheel[level][timer->slot];
+    if (timer->next)
+	timer->next->prev = timer;
+    wheel[level][timer->slot] = timer;
+}
+
+static void wheel_remove(Timer *timer)
+{
+    if (timer->prev)
+	timer->prev->next = timer->next;
+    else
+	wheel[timer->level][timer->slot] = timer->next;
+    if (timer->next)
+	timer->next->prev = timer->prev;
+}
+
+/* Modifies:	The wheel.
+ * Effects:	Places the timers in the current slot of level again, on lower
+ *		levels now that they are nearer. */
+static void cascade(int level)
+{
+    Timer *timer, *next;
+    int slot;
+
+    slot = (wheel_time >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    timer = wheel[level][slot];
+    wheel[level][slot] = NULL;
+    for (; timer; timer = next) {
+	next = timer->next;
+	wheel_insert(timer);
+    }
+}
+
+static void rehash(void)
+{
+    Timer **old = hashtab, *timer, *next;
+    long old_size = hashtab_size, i, ind;
+
+    hashtab_size = hashtab_size * 2 + MALLOC_DELTA;
+    hashtab = EMALLOC(Timer *, hashtab_size);
+    for (i = 0; i < hashtab_size; i++)
+	hashtab[i] = NULL;
+
+    for (i = 0; i < old_size; i++) {
+	for (timer = old[i]; timer; timer = next) {
+	    next = timer->hash_next;
+	    ind = HASH(timer->id);
+	    timer->hash_next = hashtab[ind];
+	    hashtab[ind] = timer;
+	}
+    }
+    free(old);
+}
+
@@ -0,0 +1,36 @@
+/* timer.h: Declarations for the timer wheel. */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+typedef struct timer Timer;
+
+#include <sys/types.h>
+#include "execute.h"
+
+/* A timer is either a forked task waiting for its start time, or a message
+ * which schedule() will send in a new task.  Either way, its ID is the ID of
+ * the task, so that cancel() can find it. */
+struct timer {
+    long id;
+    time_t when;
+    Task *task;			/* Forked task, or NULL for a message. */
+    Dbref dbref;
+    Ident message;
+    List *args;
+    int level;			/* Where it is in the wheel. */
+    int slot;
+    Timer *prev, *next;		/* Other timers in the same slot. */
+    Timer *hash_next;		/* Other timers in the same ID bucket. */
+};
+
+void init_timers(void);
+Timer *timer_add(long id, time_t when);
+Timer *timer_take(long id);
+Timer *timer_expire(time_t now);
+int timer_wait(time_t now);
+Timer *timer_next(Timer *timer);
+void timer_discard(Timer *timer);
+
+#endif
+
@@ -0,0 +1,5 @@
+#!/bin/sh
+
+cp benchmark textdump
+time $1 . 2> output
+rm -rf textdump binary output